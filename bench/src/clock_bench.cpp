@@ -0,0 +1,54 @@
+// cost of a clock reading, the steady clock against the calibrated TSC of LoopClock,
+// and of the log timestamp, strftime on every line against the one cached per second.
+
+#include <stdio.h>
+#include <time.h>
+
+#include <chrono>
+
+#include "log.hpp"
+#include "loop_clock.hpp"
+
+using namespace std;
+
+constexpr size_t READS_PER_RUN = 10000000;
+
+template <typename ReadFunc>
+static double NsPerRead(ReadFunc _read) {
+    int64_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < READS_PER_RUN; i++) { sink += _read(); }
+    auto elapsed = chrono::steady_clock::now() - start;
+    // keeps the reads from being optimized away
+    if (sink == 42) { printf(" "); }
+    return double(chrono::duration_cast<chrono::nanoseconds>(elapsed).count()) / double(READS_PER_RUN);
+}
+
+// what every log line paid before
+static int64_t FormatEveryTime() {
+    char time_str[32];
+    struct tm info;
+    auto ms_time = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    time_t in_time_t = ms_time / MILLISECONDS_PER_SECOND;
+    localtime_r(&in_time_t, &info);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &info);
+    return time_str[0];
+}
+
+int main() {
+    printf("%-24s %10s\n", "reading", "ns");
+    printf("%-24s %10.1f\n", "steady_clock", NsPerRead([]() {
+               return chrono::steady_clock::now().time_since_epoch().count();
+           }));
+    printf("%-24s %10.1f\n", "strftime per line", NsPerRead(&FormatEveryTime));
+    printf("%-24s %10.1f\n", "cached log time", NsPerRead([]() { return int64_t(FormatLogTime()[0]); }));
+    if (!nd::LoopClock::EnableTsc()) {
+        printf("no invariant TSC\n");
+        return 0;
+    }
+    printf("%-24s %10.1f\n", "LoopClock tsc", NsPerRead([]() {
+               return nd::LoopClock::Now().time_since_epoch().count();
+           }));
+    printf("%-24s %10.1f\n", "cached log time tsc", NsPerRead([]() { return int64_t(FormatLogTime()[0]); }));
+    return 0;
+}
@@ -0,0 +1,70 @@
+// spawn and complete throughput of nd::Task, pooled coroutine frames against the plain heap
+// each worker runs a loop spawning a child on the next worker and awaiting it,
+// so every frame is allocated on one worker and freed on another.
+// the heap side passes std::allocator through std::allocator_arg, which is what the frames did before.
+
+// the trace logs of the tasks would dwarf the allocations
+#define ND_LOG_LEVEL WARN
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "task.hpp"
+#include "worker_manager.hpp"
+
+using namespace std;
+
+constexpr unsigned BENCH_GROUP = 0;
+constexpr size_t SPAWNS_PER_RUN = 400000;
+
+static nd::Task<size_t> PooledChild(size_t _value) { co_return _value; }
+
+static nd::Task<size_t> HeapChild(allocator_arg_t, const allocator<byte>&, size_t _value) { co_return _value; }
+
+template <bool IS_POOLED>
+static nd::Task<> SpawnLoop(size_t _session, size_t _count, atomic<size_t>* _done_count) {
+    size_t sum = 0;
+    for (size_t i = 0; i < _count; i++) {
+        auto child = IS_POOLED ? PooledChild(i) : HeapChild(allocator_arg, allocator<byte>(), i);
+        sum += co_await child.RunOnProcessor(BENCH_GROUP, _session + 1);
+    }
+    if (sum == 42) { printf(" "); }
+    _done_count->fetch_add(1, memory_order_release);
+}
+
+template <bool IS_POOLED>
+static double Run(unsigned _thread_count) {
+    size_t count = SPAWNS_PER_RUN / _thread_count;
+    atomic<size_t> done_count{0};
+    auto start = chrono::steady_clock::now();
+    vector<nd::Task<>> loops;
+    for (unsigned i = 0; i < _thread_count; i++) {
+        loops.push_back(SpawnLoop<IS_POOLED>(i, count, &done_count));
+        loops.back().RunOnProcessor(BENCH_GROUP, i);
+    }
+    while (done_count.load(memory_order_acquire) < _thread_count) { this_thread::yield(); }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return count * _thread_count / elapsed.count();
+}
+
+int main() {
+    unsigned max_thread_count = max(4u, thread::hardware_concurrency());
+    printf("%-10s %20s %20s\n", "workers", "pooled(task/s)", "heap(task/s)");
+    for (unsigned thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+        g_worker_mgr->Init(1);
+        g_worker_mgr->Start(BENCH_GROUP, thread_count, "bench");
+        // twice each, the first round warms the pools up
+        double pooled_rate = (Run<true>(thread_count), Run<true>(thread_count));
+        double heap_rate = (Run<false>(thread_count), Run<false>(thread_count));
+        g_worker_mgr->StopAll();
+        printf("%-10u %20.0f %20.0f\n", thread_count, pooled_rate, heap_rate);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+// producer scaling of the worker run queue
+// N producer threads fan in to one worker, compared with the former
+// std::mutex + std::list<Job*> queue driven the same way.
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "worker_group.hpp"
+
+using namespace std;
+
+constexpr size_t JOBS_PER_RUN = 2000000;
+
+// the queue the worker used before, kept here as the reference
+class LockedListQueue {
+public:
+    LockedListQueue() : m_is_to_stop(false) { m_thread = thread(&LockedListQueue::ThreadMain, this); }
+    ~LockedListQueue() {
+        {
+            lock_guard<mutex> lock(m_queue_mutex);
+            m_is_to_stop = true;
+        }
+        m_queue_cond.notify_one();
+        m_thread.join();
+    }
+
+    void AddJob(nd::Job* _job) {
+        bool job_queue_empty = false;
+        {
+            lock_guard<mutex> lock(m_queue_mutex);
+            job_queue_empty = m_job_queue.empty();
+            m_job_queue.push_back(_job);
+        }
+        if (job_queue_empty) { m_queue_cond.notify_one(); }
+    }
+
+private:
+    void ThreadMain() {
+        while (true) {
+            nd::Job* job = nullptr;
+            {
+                unique_lock<mutex> lock(m_queue_mutex);
+                m_queue_cond.wait(lock, [this]() { return m_is_to_stop || !m_job_queue.empty(); });
+                if (m_job_queue.empty()) { return; }
+                job = m_job_queue.front();
+                m_job_queue.pop_front();
+            }
+            (*job)();
+            delete job;
+        }
+    }
+
+    list<nd::Job*> m_job_queue;
+    mutex m_queue_mutex;
+    condition_variable m_queue_cond;
+    bool m_is_to_stop;
+    thread m_thread;
+};
+
+template <typename AddJobFunc>
+double RunProducers(unsigned _producer_num, AddJobFunc _add_job) {
+    atomic<size_t> done_count{0};
+    size_t jobs_per_producer = JOBS_PER_RUN / _producer_num;
+    size_t total = jobs_per_producer * _producer_num;
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> producers;
+    producers.reserve(_producer_num);
+    for (unsigned i = 0; i < _producer_num; i++) {
+        producers.emplace_back([&]() {
+            for (size_t j = 0; j < jobs_per_producer; j++) {
+                _add_job(new nd::Job{[&done_count]() { done_count.fetch_add(1, memory_order_relaxed); }});
+            }
+        });
+    }
+    for (auto& producer : producers) { producer.join(); }
+    while (done_count.load(memory_order_relaxed) < total) { this_thread::yield(); }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return total / elapsed.count();
+}
+
+int main() {
+    unsigned max_producer_num = max(4u, thread::hardware_concurrency());
+    printf("%-10s %20s %20s\n", "producers", "mpsc queue(job/s)", "mutex list(job/s)");
+    for (unsigned producer_num = 1; producer_num <= max_producer_num; producer_num *= 2) {
+        double mpsc_rate = 0;
+        {
+            nd::WorkerGroup group(0, 1, "bench");
+            group.Start();
+            mpsc_rate = RunProducers(producer_num, [&group](nd::Job* _job) { group.AddJob(0, _job); });
+            group.WaitStop();
+        }
+        double locked_rate = 0;
+        {
+            LockedListQueue queue;
+            locked_rate = RunProducers(producer_num, [&queue](nd::Job* _job) { queue.AddJob(_job); });
+        }
+        printf("%-10u %20.0f %20.0f\n", producer_num, mpsc_rate, locked_rate);
+    }
+    return 0;
+}
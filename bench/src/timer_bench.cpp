@@ -0,0 +1,82 @@
+// worker timer backends, binary heap against hierarchical timing wheel
+// the session timeout pattern: lots of long timers which are cancelled before they fire,
+// then as many short ones which do fire,
+// reports ns per add, per cancel and per expiry(time spent in HandleLocalTimer only).
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "worker.hpp"
+
+using namespace std;
+
+constexpr uint64_t MIN_TIMEOUT_MS = 1000;
+constexpr uint64_t MAX_TIMEOUT_MS = 60000;
+constexpr uint64_t MAX_EXPIRY_MS = 100;
+
+struct RunResult {
+    double m_add_ns;
+    double m_cancel_ns;
+    double m_expire_ns;
+};
+
+static double NsPerOp(chrono::steady_clock::duration _elapsed, size_t _count) {
+    return double(chrono::duration_cast<chrono::nanoseconds>(_elapsed).count()) / double(_count);
+}
+
+static RunResult Run(nd::TimerBackend _backend, size_t _timer_count) {
+    RunResult result = {};
+    string name = "bench";
+    nd::WorkerGroupOptions options;
+    options.m_timer_backend = _backend;
+    // driven by hand on this thread
+    nd::Worker worker;
+    worker.Init(0, 0, 1, name, options);
+
+    mt19937_64 random(42);
+    uniform_int_distribution<uint64_t> timeout_ms(MIN_TIMEOUT_MS, MAX_TIMEOUT_MS);
+    size_t fired_count = 0;
+    vector<nd::TimerHandle> timers(_timer_count);
+
+    auto start = chrono::steady_clock::now();
+    for (auto& timer : timers) { timer = worker.AddLocalTimer(timeout_ms(random), [&fired_count]() { fired_count++; }); }
+    result.m_add_ns = NsPerOp(chrono::steady_clock::now() - start, _timer_count);
+
+    // in no particular order
+    shuffle(timers.begin(), timers.end(), random);
+    start = chrono::steady_clock::now();
+    for (auto& timer : timers) { worker.CancelLocalTimer(timer); }
+    result.m_cancel_ns = NsPerOp(chrono::steady_clock::now() - start, _timer_count);
+
+    // short timeouts, only the time in HandleLocalTimer() counts
+    uniform_int_distribution<uint64_t> expiry_ms(0, MAX_EXPIRY_MS);
+    for (size_t i = 0; i < _timer_count; i++) {
+        worker.AddLocalTimer(expiry_ms(random), [&fired_count]() { fired_count++; });
+    }
+    chrono::steady_clock::duration expire_time{0};
+    while (fired_count < _timer_count) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+        start = chrono::steady_clock::now();
+        worker.HandleLocalTimer();
+        expire_time += chrono::steady_clock::now() - start;
+    }
+    result.m_expire_ns = NsPerOp(expire_time, _timer_count);
+    return result;
+}
+
+int main() {
+    printf("%-10s %-6s %12s %12s %12s\n", "timers", "", "add(ns)", "cancel(ns)", "expire(ns)");
+    for (size_t timer_count : {size_t(10000), size_t(100000), size_t(1000000)}) {
+        RunResult heap = Run(nd::TimerBackend::Heap, timer_count);
+        RunResult wheel = Run(nd::TimerBackend::Wheel, timer_count);
+        printf("%-10zu %-6s %12.1f %12.1f %12.1f\n", timer_count, "heap", heap.m_add_ns, heap.m_cancel_ns, heap.m_expire_ns);
+        printf("%-10s %-6s %12.1f %12.1f %12.1f\n", "", "wheel", wheel.m_add_ns, wheel.m_cancel_ns, wheel.m_expire_ns);
+    }
+    return 0;
+}
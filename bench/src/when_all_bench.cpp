@@ -0,0 +1,84 @@
+// 1k-way fan-out of nd::Task across a worker group, WhenAll against awaiting the tasks one by one
+// a driver on one worker spawns FAN_OUT children spread over the group by session, then waits for all of them,
+// reports fan-outs per second and ns per child.
+// WhenAny of the same children is timed too, the losers are left running by themselves.
+
+// the trace logs of the tasks would dwarf the rest
+#define ND_LOG_LEVEL WARN
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "task.hpp"
+#include "when_all.hpp"
+#include "worker_manager.hpp"
+
+using namespace std;
+
+constexpr unsigned BENCH_GROUP = 0;
+constexpr size_t FAN_OUT = 1000;
+constexpr size_t ROUNDS = 200;
+
+enum class Mode { OneByOne, WhenAll, WhenAny };
+
+static nd::Task<size_t> Child(size_t _value) { co_return _value; }
+
+static nd::Task<> Driver(Mode _mode, atomic<bool>* _is_done) {
+    size_t sum = 0;
+    vector<nd::Task<size_t>> children;
+    children.reserve(FAN_OUT);
+    for (size_t round = 0; round < ROUNDS; round++) {
+        children.clear();
+        for (size_t i = 0; i < FAN_OUT; i++) {
+            children.push_back(Child(i));
+            children.back().RunOnProcessor(BENCH_GROUP, i);
+        }
+        if (_mode == Mode::OneByOne) {
+            for (auto& child : children) { sum += co_await child; }
+        } else if (_mode == Mode::WhenAll) {
+            co_await nd::WhenAll(children);
+            for (auto& child : children) { sum += co_await child; }
+        } else {
+            sum += co_await nd::WhenAny(children);
+        }
+    }
+    if (sum == 42) { printf(" "); }
+    _is_done->store(true, memory_order_release);
+}
+
+static double Run(Mode _mode) {
+    atomic<bool> is_done{false};
+    auto start = chrono::steady_clock::now();
+    auto driver = Driver(_mode, &is_done);
+    driver.RunOnProcessor(BENCH_GROUP, 0);
+    while (!is_done.load(memory_order_acquire)) { this_thread::yield(); }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return ROUNDS / elapsed.count();
+}
+
+int main() {
+    unsigned max_thread_count = max(4u, thread::hardware_concurrency());
+    printf("fan-out %zu\n", FAN_OUT);
+    printf("%-10s %18s %18s %18s %14s %14s\n", "workers", "one by one(/s)", "WhenAll(/s)", "WhenAny(/s)",
+           "by one(ns)", "WhenAll(ns)");
+    for (unsigned thread_count = 2; thread_count <= max_thread_count; thread_count *= 2) {
+        g_worker_mgr->Init(1);
+        g_worker_mgr->Start(BENCH_GROUP, thread_count, "bench");
+        // twice each, the first round warms the frame pools up
+        double one_by_one_rate = (Run(Mode::OneByOne), Run(Mode::OneByOne));
+        double when_all_rate = (Run(Mode::WhenAll), Run(Mode::WhenAll));
+        double when_any_rate = (Run(Mode::WhenAny), Run(Mode::WhenAny));
+        // the losers of the last WhenAny may still be running
+        this_thread::sleep_for(chrono::milliseconds(100));
+        g_worker_mgr->StopAll();
+        printf("%-10u %18.0f %18.0f %18.0f %14.1f %14.1f\n", thread_count, one_by_one_rate, when_all_rate,
+               when_any_rate, 1e9 / one_by_one_rate / FAN_OUT, 1e9 / when_all_rate / FAN_OUT);
+    }
+    return 0;
+}
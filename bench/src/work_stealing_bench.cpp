@@ -0,0 +1,76 @@
+// skewed load on a worker group, round robin placement against work stealing
+// every 16th job is 100x heavier, so some workers fall behind while others idle,
+// reports the throughput and the queueing latency(enqueue to start) percentiles.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "worker_group.hpp"
+
+using namespace std;
+
+constexpr size_t JOBS_PER_RUN = 200000;
+constexpr unsigned HEAVY_EVERY = 16;
+constexpr unsigned LIGHT_SPIN = 200;
+constexpr unsigned HEAVY_SPIN = LIGHT_SPIN * 100;
+
+// written by the spin so that it is not optimized away
+volatile unsigned g_spin_sink = 0;
+
+static void Spin(unsigned _count) {
+    for (unsigned i = 0; i < _count; i++) { g_spin_sink = i; }
+}
+
+struct RunResult {
+    double m_rate;
+    double m_p50_us;
+    double m_p99_us;
+};
+
+RunResult RunSkewed(unsigned _thread_count, bool _is_work_stealing) {
+    nd::WorkerGroupOptions options;
+    options.m_work_stealing = _is_work_stealing;
+    nd::WorkerGroup group(0, _thread_count, "bench", options);
+    group.Start();
+
+    vector<float> latency_us(JOBS_PER_RUN);
+    atomic<size_t> done_count{0};
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < JOBS_PER_RUN; i++) {
+        auto enqueue_time = chrono::steady_clock::now();
+        group.AddJob(nd::ANY_SESSION, [&latency_us, &done_count, enqueue_time, i]() {
+            chrono::duration<float, micro> wait = chrono::steady_clock::now() - enqueue_time;
+            latency_us[i] = wait.count();
+            Spin(i % HEAVY_EVERY == 0 ? HEAVY_SPIN : LIGHT_SPIN);
+            done_count.fetch_add(1, memory_order_release);
+        });
+    }
+    while (done_count.load(memory_order_acquire) < JOBS_PER_RUN) { this_thread::yield(); }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    group.WaitStop();
+
+    sort(latency_us.begin(), latency_us.end());
+    return {JOBS_PER_RUN / elapsed.count(), latency_us[JOBS_PER_RUN / 2], latency_us[JOBS_PER_RUN * 99 / 100]};
+}
+
+int main() {
+    unsigned max_thread_count = max(4u, thread::hardware_concurrency());
+    printf("%-8s %-12s %15s %12s %12s\n", "threads", "placement", "job/s", "p50(us)", "p99(us)");
+    for (unsigned thread_count = 2; thread_count <= max_thread_count; thread_count *= 2) {
+        for (bool is_work_stealing : {false, true}) {
+            RunResult result = RunSkewed(thread_count, is_work_stealing);
+            printf("%-8u %-12s %15.0f %12.1f %12.1f\n",
+                   thread_count,
+                   is_work_stealing ? "stealing" : "round robin",
+                   result.m_rate,
+                   result.m_p50_us,
+                   result.m_p99_us);
+        }
+    }
+    return 0;
+}
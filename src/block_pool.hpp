@@ -0,0 +1,144 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+#include "mpsc_queue.hpp"
+
+namespace nd {
+
+//-----------------------------------------
+// Fixed size block allocator with a cache per thread.
+// Allocating and freeing on the thread which carved the block touch no atomic,
+// a block freed on another thread is pushed to its owner's lock-free return stack,
+// and the owner takes the whole stack back once its local free list runs dry.
+// A cache left by an exited thread is adopted by the next new thread,
+// memory goes back to the system only when the process exits.
+//-----------------------------------------
+template <size_t BlockSize>
+class BlockPool {
+public:
+    // the payload keeps the alignment of operator new
+    static constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+    static constexpr size_t PAYLOAD_SIZE = std::max(BlockSize, sizeof(void*));
+    static constexpr size_t STRIDE =
+        (HEADER_SIZE + PAYLOAD_SIZE + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) *
+        alignof(std::max_align_t);
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t BLOCKS_PER_CHUNK = std::max<size_t>(16, CHUNK_SIZE / STRIDE);
+
+    static void* Allocate() {
+        BlockCache* cache = s_local_cache;
+        if (cache == nullptr) { cache = AcquireCache(); }
+
+        FreeBlock* block = cache->m_free_list;
+        if (block == nullptr) {
+            block = cache->m_remote_free_list.exchange(nullptr, std::memory_order_acquire);
+            if (block == nullptr) { block = Carve(cache); }
+        }
+        cache->m_free_list = block->m_next;
+        return block;
+    }
+
+    static void Free(void* _ptr) {
+        if (_ptr == nullptr) { return; }
+
+        auto* block = static_cast<FreeBlock*>(_ptr);
+        BlockCache* owner = OwnerOf(_ptr);
+        if (owner == s_local_cache) {
+            block->m_next = owner->m_free_list;
+            owner->m_free_list = block;
+            return;
+        }
+
+        FreeBlock* head = owner->m_remote_free_list.load(std::memory_order_relaxed);
+        do {
+            block->m_next = head;
+        } while (!owner->m_remote_free_list.compare_exchange_weak(
+            head, block, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* m_next;
+    };
+
+    struct Chunk {
+        Chunk* m_next_chunk;
+    };
+
+    struct BlockCache {
+        FreeBlock* m_free_list = nullptr;
+        Chunk* m_chunks = nullptr;
+        BlockCache* m_next_cache = nullptr;
+        std::atomic<bool> m_is_orphan{false};
+        alignas(CACHE_LINE_SIZE) std::atomic<FreeBlock*> m_remote_free_list{nullptr};
+    };
+
+    // marks the cache as adoptable when its thread exits
+    struct CacheHolder {
+        BlockCache* m_cache = nullptr;
+        ~CacheHolder() {
+            if (m_cache == nullptr) { return; }
+            s_local_cache = nullptr;
+            m_cache->m_is_orphan.store(true, std::memory_order_release);
+        }
+    };
+
+    static BlockCache*& OwnerOf(void* _ptr) {
+        return *reinterpret_cast<BlockCache**>(static_cast<char*>(_ptr) - HEADER_SIZE);
+    }
+
+    static BlockCache* AcquireCache() {
+        BlockCache* cache = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(s_registry_mutex);
+            for (BlockCache* it = s_caches; it != nullptr; it = it->m_next_cache) {
+                bool is_orphan = true;
+                if (it->m_is_orphan.compare_exchange_strong(is_orphan, false, std::memory_order_acquire)) {
+                    cache = it;
+                    break;
+                }
+            }
+            if (cache == nullptr) {
+                cache = new BlockCache();
+                cache->m_next_cache = s_caches;
+                s_caches = cache;
+            }
+        }
+        s_local_cache = cache;
+        s_holder.m_cache = cache;
+        return cache;
+    }
+
+    static FreeBlock* Carve(BlockCache* _cache) {
+        // the chunk link takes the first stride, so that the blocks keep their alignment
+        char* memory = static_cast<char*>(::operator new(STRIDE * (BLOCKS_PER_CHUNK + 1)));
+        auto* chunk = reinterpret_cast<Chunk*>(memory);
+        chunk->m_next_chunk = _cache->m_chunks;
+        _cache->m_chunks = chunk;
+
+        FreeBlock* free_list = nullptr;
+        for (size_t i = BLOCKS_PER_CHUNK; i > 0; i--) {
+            char* payload = memory + STRIDE * i + HEADER_SIZE;
+            OwnerOf(payload) = _cache;
+            auto* block = reinterpret_cast<FreeBlock*>(payload);
+            block->m_next = free_list;
+            free_list = block;
+        }
+        return free_list;
+    }
+
+    inline static thread_local BlockCache* s_local_cache = nullptr;
+    inline static thread_local CacheHolder s_holder;
+    inline static std::mutex s_registry_mutex;
+    inline static BlockCache* s_caches = nullptr;
+};
+}  // namespace nd
+
+#endif /* BLOCK_POOL_H */
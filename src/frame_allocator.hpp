@@ -0,0 +1,159 @@
+#ifndef FRAME_ALLOCATOR_H
+#define FRAME_ALLOCATOR_H
+
+#include <stddef.h>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "block_pool.hpp"
+
+namespace nd {
+
+//-----------------------------------------
+// Allocator of the coroutine frames.
+// A frame goes to the BlockPool of its power of two size class, so that spawning a task
+// on a worker reuses the frames freed there, a frame finishing on another worker is pushed back lock-free.
+// Frames over the biggest class, and those of a coroutine taking std::allocator_arg, alloc, ...
+// (as a member function: self, std::allocator_arg, alloc, ...) come from the plain heap or that allocator.
+// Each frame ends with a footer telling how to free it, since operator delete only gets the size.
+//-----------------------------------------
+class FrameAllocator {
+public:
+    static constexpr size_t MIN_CLASS_SIZE = 128;
+    static constexpr size_t MAX_CLASS_SIZE = 4096;
+
+    static void* Allocate(size_t _size) {
+        size_t total = FooterOffset(_size) + sizeof(Footer);
+        void* frame = nullptr;
+        void (*free_func)(void*, size_t) = nullptr;
+        if (total <= MAX_CLASS_SIZE) {
+            frame = AllocateFromClass(total, free_func);
+        } else {
+            frame = ::operator new(total);
+            free_func = &FreeToHeap;
+        }
+        FooterOf(frame, _size)->m_free = free_func;
+        return frame;
+    }
+
+    template <typename Alloc>
+    static void* Allocate(size_t _size, const Alloc& _alloc) {
+        using ByteAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<std::byte>;
+        ByteAlloc alloc(_alloc);
+        size_t total = AllocatorOffset<ByteAlloc>(_size) + sizeof(ByteAlloc);
+        void* frame = std::allocator_traits<ByteAlloc>::allocate(alloc, total);
+        FooterOf(frame, _size)->m_free = &FreeToAllocator<ByteAlloc>;
+        new (static_cast<char*>(frame) + AllocatorOffset<ByteAlloc>(_size)) ByteAlloc(std::move(alloc));
+        return frame;
+    }
+
+    static void Free(void* _frame, size_t _size) { FooterOf(_frame, _size)->m_free(_frame, _size); }
+
+private:
+    struct Footer {
+        void (*m_free)(void* _frame, size_t _size);
+    };
+
+    static constexpr size_t AlignUp(size_t _size, size_t _align) { return (_size + _align - 1) / _align * _align; }
+    static constexpr size_t FooterOffset(size_t _size) { return AlignUp(_size, alignof(Footer)); }
+    template <typename ByteAlloc>
+    static constexpr size_t AllocatorOffset(size_t _size) {
+        return AlignUp(FooterOffset(_size) + sizeof(Footer), alignof(ByteAlloc));
+    }
+    static Footer* FooterOf(void* _frame, size_t _size) {
+        return reinterpret_cast<Footer*>(static_cast<char*>(_frame) + FooterOffset(_size));
+    }
+
+    template <size_t ClassSize>
+    static void FreeToClass(void* _frame, size_t) {
+        BlockPool<ClassSize>::Free(_frame);
+    }
+
+    template <size_t ClassSize = MIN_CLASS_SIZE>
+    static void* AllocateFromClass(size_t _total, void (*&_free_func)(void*, size_t)) {
+        if constexpr (ClassSize < MAX_CLASS_SIZE) {
+            if (_total > ClassSize) { return AllocateFromClass<ClassSize * 2>(_total, _free_func); }
+        }
+        _free_func = &FreeToClass<ClassSize>;
+        return BlockPool<ClassSize>::Allocate();
+    }
+
+    static void FreeToHeap(void* _frame, size_t) { ::operator delete(_frame); }
+
+    template <typename ByteAlloc>
+    static void FreeToAllocator(void* _frame, size_t _size) {
+        auto* stored = reinterpret_cast<ByteAlloc*>(static_cast<char*>(_frame) + AllocatorOffset<ByteAlloc>(_size));
+        ByteAlloc alloc(std::move(*stored));
+        stored->~ByteAlloc();
+        std::allocator_traits<ByteAlloc>::deallocate(
+            alloc, static_cast<std::byte*>(_frame), AllocatorOffset<ByteAlloc>(_size) + sizeof(ByteAlloc));
+    }
+};
+
+//-----------------------------------------
+// Promise base which puts the coroutine frames in the FrameAllocator.
+//-----------------------------------------
+class FramePromise {
+public:
+    static void* operator new(size_t _size) { return FrameAllocator::Allocate(_size); }
+    static void operator delete(void* _frame, size_t _size) { FrameAllocator::Free(_frame, _size); }
+};
+
+//-----------------------------------------
+// Promise base of a coroutine with the parameters Params which passes an allocator,
+// the frame comes from that allocator.
+// operator new takes the parameters as a member of the class template rather than as a template itself,
+// so that the compiler sees it paired with the usual operator delete.
+//-----------------------------------------
+template <typename Alloc, typename... Params>
+class AllocatorFramePromise {
+public:
+    static void* operator new(size_t _size, const std::remove_reference_t<Params>&... _params) {
+        return FrameAllocator::Allocate(_size, AllocatorAfterTag(_params...));
+    }
+    static void operator delete(void* _frame, size_t _size) { FrameAllocator::Free(_frame, _size); }
+
+private:
+    template <typename First, typename Second, typename... Rest>
+    static const Alloc& AllocatorAfterTag(const First&, const Second& _second, const Rest&... _rest) {
+        if constexpr (std::is_same_v<First, std::allocator_arg_t>) {
+            return _second;
+        } else {
+            return AllocatorAfterTag(_second, _rest...);
+        }
+    }
+};
+
+// the allocator a coroutine with the parameters Params passes, void for none:
+// (std::allocator_arg_t, const Alloc&, ...),
+// or (self, std::allocator_arg_t, const Alloc&, ...) for a member function or a lambda, self being of a class type
+template <typename... Params>
+struct AllocatorAfterTagOf {
+    using type = void;
+};
+template <typename Tag, typename Alloc, typename... Rest>
+    requires std::is_same_v<std::remove_cvref_t<Tag>, std::allocator_arg_t>
+struct AllocatorAfterTagOf<Tag, Alloc, Rest...> {
+    using type = std::remove_cvref_t<Alloc>;
+};
+
+template <typename... Params>
+struct FrameAllocatorOf : AllocatorAfterTagOf<Params...> {};
+template <typename Self, typename... Rest>
+    requires std::is_class_v<std::remove_cvref_t<Self>> &&
+             (!std::is_same_v<std::remove_cvref_t<Self>, std::allocator_arg_t>)
+struct FrameAllocatorOf<Self, Rest...> : AllocatorAfterTagOf<Rest...> {};
+
+// the promise base for a coroutine with the parameters Params
+template <typename... Params>
+using FramePromiseOf =
+    std::conditional_t<std::is_void_v<typename FrameAllocatorOf<Params...>::type>,
+                       FramePromise,
+                       AllocatorFramePromise<typename FrameAllocatorOf<Params...>::type, Params...>>;
+}  // namespace nd
+
+#endif /* FRAME_ALLOCATOR_H */
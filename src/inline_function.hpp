@@ -0,0 +1,107 @@
+#ifndef INLINE_FUNCTION_H
+#define INLINE_FUNCTION_H
+
+#include <stddef.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace nd {
+
+//-----------------------------------------
+// Move-only void() callable with an inline capture buffer.
+// Callables which fit the buffer are stored in place and never allocate,
+// bigger ones are boxed on the heap, that is the slow path and should stay rare.
+//-----------------------------------------
+template <size_t InlineSize>
+class InlineFunction {
+public:
+    template <typename Func>
+    static constexpr bool IsInline() {
+        return sizeof(Func) <= InlineSize && alignof(Func) <= alignof(void*) &&
+               std::is_nothrow_move_constructible_v<Func>;
+    }
+
+    InlineFunction() : m_ops(nullptr) {}
+
+    template <typename Func>
+        requires(!std::is_same_v<std::decay_t<Func>, InlineFunction> && std::is_invocable_v<std::decay_t<Func>&>)
+    InlineFunction(Func&& _func) : m_ops(&OpsOf<std::decay_t<Func>>::OPS) {
+        using Stored = std::decay_t<Func>;
+        if constexpr (IsInline<Stored>()) {
+            new (m_storage) Stored(std::forward<Func>(_func));
+        } else {
+            *reinterpret_cast<Stored**>(m_storage) = new Stored(std::forward<Func>(_func));
+        }
+    }
+
+    InlineFunction(InlineFunction&& _other) noexcept : m_ops(_other.m_ops) {
+        if (m_ops != nullptr) {
+            m_ops->m_move(m_storage, _other.m_storage);
+            _other.m_ops = nullptr;
+        }
+    }
+
+    InlineFunction& operator=(InlineFunction&& _other) noexcept {
+        if (this != &_other) {
+            Reset();
+            m_ops = _other.m_ops;
+            if (m_ops != nullptr) {
+                m_ops->m_move(m_storage, _other.m_storage);
+                _other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineFunction(const InlineFunction&) = delete;
+    InlineFunction& operator=(const InlineFunction&) = delete;
+
+    ~InlineFunction() { Reset(); }
+
+    void Reset() {
+        if (m_ops != nullptr) {
+            m_ops->m_destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+    void operator()() { m_ops->m_invoke(m_storage); }
+
+private:
+    struct Ops {
+        void (*m_invoke)(void* _storage);
+        // move constructs into _dst and destroys _src
+        void (*m_move)(void* _dst, void* _src);
+        void (*m_destroy)(void* _storage);
+    };
+
+    template <typename Func, bool IS_INLINE = IsInline<Func>()>
+    struct OpsOf {
+        static Func* Get(void* _storage) { return std::launder(reinterpret_cast<Func*>(_storage)); }
+        static void Invoke(void* _storage) { (*Get(_storage))(); }
+        static void Move(void* _dst, void* _src) {
+            new (_dst) Func(std::move(*Get(_src)));
+            Get(_src)->~Func();
+        }
+        static void Destroy(void* _storage) { Get(_storage)->~Func(); }
+        static constexpr Ops OPS = {&Invoke, &Move, &Destroy};
+    };
+
+    template <typename Func>
+    struct OpsOf<Func, false> {
+        static Func*& Get(void* _storage) { return *reinterpret_cast<Func**>(_storage); }
+        static void Invoke(void* _storage) { (*Get(_storage))(); }
+        static void Move(void* _dst, void* _src) { *reinterpret_cast<Func**>(_dst) = Get(_src); }
+        static void Destroy(void* _storage) { delete Get(_storage); }
+        static constexpr Ops OPS = {&Invoke, &Move, &Destroy};
+    };
+
+    const Ops* m_ops;
+    alignas(void*) unsigned char m_storage[InlineSize];
+};
+}  // namespace nd
+
+#endif /* INLINE_FUNCTION_H */
@@ -19,6 +19,7 @@
 #include <iostream>
 #include <thread>
 
+#include "loop_clock.hpp"
 #include "singleton.hpp"
 #include "worker.hpp"
 
@@ -54,26 +55,45 @@ struct const_expr_value {
 
 const char* const g_log_filename = "log.log";
 enum class LogLevel { TRACE = 0, DEBUG, INFO, WARN, ERROR, FATAL };
-const int g_log_level = (int)LogLevel::TRACE;
+#ifndef ND_LOG_LEVEL
+#define ND_LOG_LEVEL TRACE
+#endif
+// define ND_LOG_LEVEL as WARN(for instance) before the include to silence the lower levels of a source file
+const int g_log_level = (int)LogLevel::ND_LOG_LEVEL;
 const char* const g_loglevel_str[] = {"TRACE ", "DEBUG ", "INFO  ", "WARN  ", "ERR   ", "FATAL "};
 
-template <typename StreamType>
-StreamType& FormatLogPrefix(StreamType& _os, const char* _level_str, const char* _file, const unsigned _lineno) {
-    struct tm info;
-    constexpr size_t TIME_STR_LEN = 80;
-    char time_str[TIME_STR_LEN];
+// "YYYY-mm-dd HH:MM:SS.mmm" of now, valid until the next call on this thread,
+// localtime_r() and strftime() only run when the second changes
+inline const char* FormatLogTime() {
+    constexpr size_t TIME_STR_LEN = 32;
+    constexpr size_t SECOND_STR_LEN = 19;
+    thread_local time_t s_second = -1;
+    thread_local char s_time_str[TIME_STR_LEN];
 
     using namespace std::chrono;
-    auto now = system_clock::now();
+    auto now = nd::LoopClock::ToWallTime(nd::LoopClock::Now());
     auto ms_time = duration_cast<milliseconds>(now.time_since_epoch()).count();
     time_t in_time_t = ms_time / MILLISECONDS_PER_SECOND;
-    auto ms_time_left = ms_time % MILLISECONDS_PER_SECOND;
-
-    localtime_r(&in_time_t, &info);
-    strftime(time_str, TIME_STR_LEN, "%Y-%m-%d %H:%M:%S", &info);
+    int ms_time_left = (int)(ms_time % MILLISECONDS_PER_SECOND);
+    if (in_time_t != s_second) {
+        struct tm info;
+        localtime_r(&in_time_t, &info);
+        strftime(s_time_str, TIME_STR_LEN, "%Y-%m-%d %H:%M:%S", &info);
+        s_second = in_time_t;
+    }
+    char* ms_str = s_time_str + SECOND_STR_LEN;
+    ms_str[0] = '.';
+    ms_str[1] = char('0' + ms_time_left / 100);
+    ms_str[2] = char('0' + ms_time_left / 10 % 10);
+    ms_str[3] = char('0' + ms_time_left % 10);
+    ms_str[4] = '\0';
+    return s_time_str;
+}
 
-    _os << time_str << '.' << std::setfill('0') << std::setw(3) << ms_time_left << " " << _level_str
-        << nd::Worker::GetCurrWorkerName() << "(" << _file << ":" << _lineno << ") ";
+template <typename StreamType>
+StreamType& FormatLogPrefix(StreamType& _os, const char* _level_str, const char* _file, const unsigned _lineno) {
+    _os << FormatLogTime() << " " << _level_str << nd::Worker::GetCurrWorkerName() << "(" << _file << ":" << _lineno
+        << ") ";
     return _os;
 }
 
@@ -126,40 +146,26 @@ private:
         }                                                                                              \
     }
 
-#define FMT_LOG(pfunc, level, to_err, fmt, ...)                                         \
-    {                                                                                   \
-        if (level >= g_log_level) {                                                     \
-            struct tm info;                                                             \
-            const char* filename = __FILE_NAME__;                                       \
-            using namespace std::chrono;                                                \
-            auto now = system_clock::now();                                             \
-            auto ms_time = duration_cast<milliseconds>(now.time_since_epoch()).count(); \
-            time_t in_time_t = ms_time / MILLISECONDS_PER_SECOND;                       \
-            int ms_time_left = (int)(ms_time % MILLISECONDS_PER_SECOND);                \
-                                                                                        \
-            localtime_r(&in_time_t, &info);                                             \
-            std::lock_guard<std::mutex> lock(g_file_logger->Mutex());                   \
-            pfunc("%04d-%02d-%02d %02d:%02d:%02d.%03d %s%s(%s:%d) " fmt "\n",           \
-                  info.tm_year + 1900,                                                  \
-                  info.tm_mon + 1,                                                      \
-                  info.tm_mday,                                                         \
-                  info.tm_hour,                                                         \
-                  info.tm_min,                                                          \
-                  info.tm_sec,                                                          \
-                  ms_time_left,                                                         \
-                  g_loglevel_str[level],                                                \
-                  nd::Worker::GetCurrWorkerName(),                                      \
-                  filename,                                                             \
-                  __LINE__,                                                             \
-                  ##__VA_ARGS__);                                                       \
-        }                                                                               \
+#define FMT_LOG(pfunc, level, to_err, fmt, ...)                          \
+    {                                                                    \
+        if (level >= g_log_level) {                                      \
+            const char* filename = __FILE_NAME__;                        \
+            std::lock_guard<std::mutex> lock(g_file_logger->Mutex());    \
+            pfunc("%s %s%s(%s:%d) " fmt "\n",                           \
+                  FormatLogTime(),                                       \
+                  g_loglevel_str[level],                                 \
+                  nd::Worker::GetCurrWorkerName(),                       \
+                  filename,                                              \
+                  __LINE__,                                              \
+                  ##__VA_ARGS__);                                        \
+        }                                                                \
     }
 
 // log relate
 #define LOG_TRACE(msg) STD_LOG(((int)LogLevel::TRACE), false, msg)
 #define LOG_DEBUG(msg) STD_LOG(((int)LogLevel::DEBUG), false, msg)
-#define LOG_INFO (msg) STD_LOG(((int)LogLevel::INFO), false, msg)
-#define LOG_WARN (msg) STD_LOG(((int)LogLevel::WARN), false, msg)
+#define LOG_INFO(msg) STD_LOG(((int)LogLevel::INFO), false, msg)
+#define LOG_WARN(msg) STD_LOG(((int)LogLevel::WARN), false, msg)
 #define LOG_ERROR(msg) STD_LOG(((int)LogLevel::ERROR), true, msg)
 #define LOG_FATAL(msg) STD_LOG(((int)LogLevel::FATAL), true, msg)
 
@@ -0,0 +1,83 @@
+#include "loop_clock.hpp"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+using namespace nd;
+using namespace std;
+
+std::atomic<bool> LoopClock::s_is_tsc_enabled{false};
+
+namespace {
+// the system clock less the steady clock, taken once
+chrono::system_clock::duration WallOffset() {
+    static const chrono::system_clock::duration s_offset =
+        chrono::system_clock::now().time_since_epoch() -
+        chrono::duration_cast<chrono::system_clock::duration>(chrono::steady_clock::now().time_since_epoch());
+    return s_offset;
+}
+
+#if defined(__x86_64__)
+// Now() = s_time_base + (rdtsc - s_tsc_base) * s_ns_per_tick / 2^32
+uint64_t s_tsc_base = 0;
+LoopClock::TimePoint s_time_base;
+uint64_t s_ns_per_tick = 0;
+
+bool HasInvariantTsc() {
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) { return false; }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    constexpr unsigned INVARIANT_TSC_BIT = 1u << 8;
+    return (edx & INVARIANT_TSC_BIT) != 0;
+}
+#endif
+}  // namespace
+
+//-----------------------------------------------------------------------------
+
+chrono::system_clock::time_point LoopClock::ToWallTime(TimePoint _time) {
+    return chrono::system_clock::time_point(
+        chrono::duration_cast<chrono::system_clock::duration>(_time.time_since_epoch()) + WallOffset());
+}
+
+#if defined(__x86_64__)
+
+//-----------------------------------------------------------------------------
+
+LoopClock::TimePoint LoopClock::TscNow() {
+    uint64_t ticks = __rdtsc() - s_tsc_base;
+    auto ns = static_cast<int64_t>((static_cast<unsigned __int128>(ticks) * s_ns_per_tick) >> 32);
+    return s_time_base + chrono::nanoseconds(ns);
+}
+
+//-----------------------------------------------------------------------------
+
+bool LoopClock::EnableTsc(unsigned _calibration_ms) {
+    if (IsTscEnabled()) { return true; }
+    if (!HasInvariantTsc()) { return false; }
+
+    WallOffset();
+    auto time_start = chrono::steady_clock::now();
+    uint64_t tsc_start = __rdtsc();
+    auto time_end = time_start;
+    while (time_end - time_start < chrono::milliseconds(_calibration_ms)) { time_end = chrono::steady_clock::now(); }
+    uint64_t tsc_end = __rdtsc();
+    if (tsc_end <= tsc_start) { return false; }
+
+    auto elapsed_ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(time_end - time_start).count());
+    s_ns_per_tick = static_cast<uint64_t>((static_cast<unsigned __int128>(elapsed_ns) << 32) / (tsc_end - tsc_start));
+    s_tsc_base = tsc_end;
+    s_time_base = time_end;
+    s_is_tsc_enabled.store(true, std::memory_order_release);
+    return true;
+}
+
+#else
+
+//-----------------------------------------------------------------------------
+
+bool LoopClock::EnableTsc(unsigned) { return false; }
+
+#endif
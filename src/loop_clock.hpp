@@ -0,0 +1,47 @@
+#ifndef LOOP_CLOCK_H
+#define LOOP_CLOCK_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace nd {
+
+//-----------------------------------------
+// Monotonic clock of the workers, timers and logs.
+// It reads the steady clock unless the TSC is enabled: an invariant TSC(x86-64)
+// calibrated against the steady clock once, after which a read is one rdtsc and a multiply.
+// Either way it returns steady_clock time points, so the deadlines keep their type.
+// The workers read it once per batch and keep the result as their loop time.
+//-----------------------------------------
+class LoopClock {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    static TimePoint Now() {
+#if defined(__x86_64__)
+        if (s_is_tsc_enabled.load(std::memory_order_acquire)) { return TscNow(); }
+#endif
+        return std::chrono::steady_clock::now();
+    }
+
+    // the wall clock time of a Now() reading, as of the process start(or EnableTsc()),
+    // it does not follow later steps of the system clock
+    static std::chrono::system_clock::time_point ToWallTime(TimePoint _time);
+
+    // calibrates for about _calibration_ms and switches to the TSC,
+    // false if the cpu has no invariant TSC, call it once at startup before the workers run
+    static bool EnableTsc(unsigned _calibration_ms = 10);
+    static bool IsTscEnabled() { return s_is_tsc_enabled.load(std::memory_order_acquire); }
+
+private:
+#if defined(__x86_64__)
+    static TimePoint TscNow();
+#endif
+
+    static std::atomic<bool> s_is_tsc_enabled;
+};
+}  // namespace nd
+
+#endif /* LOOP_CLOCK_H */
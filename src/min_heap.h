@@ -28,18 +28,38 @@
 #ifndef _MIN_HEAP_H_
 #define _MIN_HEAP_H_
 
+#include <stdint.h>
 #include <functional>
 #include <chrono>
 
+#include "inline_function.hpp"
+#include "mylist.h"
+
 namespace nd {
 	using CppTimePoint = std::chrono::time_point < std::chrono::steady_clock >;
-	using TimerCallback = std::function<void()>;
+	/* room for a few captured pointers, bigger captures are boxed */
+	constexpr size_t TIMER_INLINE_SIZE = 4 * sizeof(void*);
+	using TimerCallback = InlineFunction<TIMER_INLINE_SIZE>;
+
+	struct min_heap_item_t;
+
+	/* slot link of a timer in a TimerWheel, node first so that a list_head* casts back */
+	struct timer_wheel_link_t {
+		struct list_head node;
+		struct min_heap_item_t* item;
+	};
 
 	struct min_heap_item_t {
 		/* for managing timeouts */
 		int min_heap_idx = -1;
 		CppTimePoint timeout;
 		TimerCallback callback;
+		/* for the timing wheel backend instead */
+		uint64_t wheel_tick = 0;
+		struct timer_wheel_link_t wheel_link = {};
+		/* slot reuse in a TimerPool */
+		uint32_t generation = 0;
+		struct min_heap_item_t* next_free = nullptr;
 	};
 
 #define item_cmp(tvp, uvp, cmp)                  \
@@ -51,8 +71,6 @@ namespace nd {
 		unsigned n, a;
 	} min_heap_t;
 
-    using TimerHandle = min_heap_item_t*;
-
 	static inline void	     min_heap_ctor(min_heap_t* s);
 	static inline void	     min_heap_dtor(min_heap_t* s);
 	static inline void	     min_heap_elem_init(struct min_heap_item_t* e);
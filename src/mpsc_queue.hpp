@@ -0,0 +1,80 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stddef.h>
+
+#include <atomic>
+
+namespace nd {
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// intrusive link, embedded in every object that goes through a MpscQueue
+struct MpscNode {
+    std::atomic<MpscNode*> m_next{nullptr};
+};
+
+//-----------------------------------------
+// Intrusive multi-producer/single-consumer queue(Dmitry Vyukov's algorithm).
+// Push is wait-free: one exchange on the head plus one store, no allocation.
+// Pop is lock-free and must only be called from the consumer thread.
+// Pop may return nullptr while a producer is between its exchange and its store,
+// the node becomes visible right after, so the caller should simply retry later.
+//-----------------------------------------
+template <typename NodeType>
+class MpscQueue {
+public:
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // any thread
+    void Push(NodeType* _node) { PushChain(_node, _node); }
+
+    // any thread, [_first, _last] must be linked through m_next already
+    void PushChain(NodeType* _first, NodeType* _last) { LinkChain(_first, _last); }
+
+    // consumer thread only
+    NodeType* Pop() {
+        MpscNode* tail = m_tail;
+        MpscNode* next = tail->m_next.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (next == nullptr) { return nullptr; }
+            m_tail = next;
+            tail = next;
+            next = next->m_next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            m_tail = next;
+            return static_cast<NodeType*>(tail);
+        }
+        if (tail != m_head.load(std::memory_order_acquire)) {
+            // a producer is in the middle of a push
+            return nullptr;
+        }
+
+        // tail is the last node, put the stub behind it so that it can be handed out
+        LinkChain(&m_stub, &m_stub);
+        next = tail->m_next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            m_tail = next;
+            return static_cast<NodeType*>(tail);
+        }
+        return nullptr;
+    }
+
+private:
+    void LinkChain(MpscNode* _first, MpscNode* _last) {
+        _last->m_next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = m_head.exchange(_last, std::memory_order_acq_rel);
+        prev->m_next.store(_first, std::memory_order_release);
+    }
+
+    // producers and the consumer live on different cache lines
+    alignas(CACHE_LINE_SIZE) std::atomic<MpscNode*> m_head;
+    alignas(CACHE_LINE_SIZE) MpscNode* m_tail;
+    MpscNode m_stub;
+};
+}  // namespace nd
+
+#endif /* MPSC_QUEUE_H */
@@ -0,0 +1,156 @@
+#include "placement.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "log.hpp"
+
+using namespace nd;
+using namespace std;
+
+#ifdef __linux__
+
+//-----------------------------------------------------------------------------
+
+// "0-3,8,10-11" as used by sysfs
+static vector<int> ParseCpuList(const string& _list) {
+    vector<int> cpus;
+    stringstream stream(_list);
+    string range;
+    while (getline(stream, range, ',')) {
+        int first = 0;
+        int last = 0;
+        int count = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (count < 1) { continue; }
+        if (count == 1) { last = first; }
+        for (int cpu = first; cpu <= last; cpu++) { cpus.push_back(cpu); }
+    }
+    return cpus;
+}
+
+//-----------------------------------------------------------------------------
+
+static string ReadSysFile(const string& _path) {
+    ifstream file(_path);
+    string content;
+    getline(file, content);
+    return content;
+}
+
+//-----------------------------------------------------------------------------
+
+static vector<int> OnlineCpus() {
+    vector<int> cpus = ParseCpuList(ReadSysFile("/sys/devices/system/cpu/online"));
+    if (cpus.empty()) { LOG_WARN("no online cpu found in sysfs"); }
+    return cpus;
+}
+
+//-----------------------------------------------------------------------------
+
+static vector<int> PhysicalCoreCpus() {
+    vector<int> cpus;
+    set<pair<string, string>> cores;
+    for (int cpu : OnlineCpus()) {
+        string topology = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/";
+        auto core = make_pair(ReadSysFile(topology + "physical_package_id"), ReadSysFile(topology + "core_id"));
+        // the first hardware thread of each core
+        if (cores.insert(core).second) { cpus.push_back(cpu); }
+    }
+    return cpus;
+}
+
+//-----------------------------------------------------------------------------
+
+static vector<int> NodeCpus(int _node) {
+    vector<int> cpus = ParseCpuList(ReadSysFile("/sys/devices/system/node/node" + to_string(_node) + "/cpulist"));
+    if (cpus.empty()) {
+        LOG_WARN("numa node " << _node << " has no cpu, falls back to all the cpus");
+        return OnlineCpus();
+    }
+    return cpus;
+}
+
+//-----------------------------------------------------------------------------
+
+vector<int> nd::ResolvePlacement(const PlacementSpec& _spec, unsigned _worker_count) {
+    vector<int> cpus;
+    switch (_spec.m_kind) {
+        case PlacementSpec::Kind::CpuList:
+            cpus = _spec.m_cpus;
+            break;
+        case PlacementSpec::Kind::OnePerCore:
+            cpus = PhysicalCoreCpus();
+            break;
+        case PlacementSpec::Kind::CompactOnNode:
+            cpus = NodeCpus(_spec.m_node);
+            break;
+        case PlacementSpec::Kind::Unpinned:
+        default:
+            break;
+    }
+
+    vector<int> placement(_worker_count, -1);
+    if (cpus.empty()) { return placement; }
+    // more workers than cpus share them in turn
+    for (unsigned i = 0; i < _worker_count; i++) { placement[i] = cpus[i % cpus.size()]; }
+    return placement;
+}
+
+//-----------------------------------------------------------------------------
+
+bool nd::PinCurrentThread(int _cpu) {
+    if (_cpu < 0 || _cpu >= CPU_SETSIZE) { return false; }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(_cpu, &cpu_set);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result != 0) {
+        LOG_WARN("failed to pin the thread to cpu " << _cpu << ", error:" << result);
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+int nd::NumaNodeOfCpu(int _cpu) {
+    if (_cpu < 0) { return -1; }
+
+    vector<int> nodes = ParseCpuList(ReadSysFile("/sys/devices/system/node/online"));
+    for (int node : nodes) {
+        vector<int> cpus = ParseCpuList(ReadSysFile("/sys/devices/system/node/node" + to_string(node) + "/cpulist"));
+        if (find(cpus.begin(), cpus.end(), _cpu) != cpus.end()) { return node; }
+    }
+    return -1;
+}
+
+#else
+
+//-----------------------------------------------------------------------------
+
+vector<int> nd::ResolvePlacement(const PlacementSpec& _spec, unsigned _worker_count) {
+    if (_spec.m_kind != PlacementSpec::Kind::Unpinned) { LOG_WARN("thread placement is only supported on linux"); }
+    return vector<int>(_worker_count, -1);
+}
+
+//-----------------------------------------------------------------------------
+
+bool nd::PinCurrentThread(int _cpu) { return false; }
+
+//-----------------------------------------------------------------------------
+
+int nd::NumaNodeOfCpu(int _cpu) { return -1; }
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace nd {
+
+//-----------------------------------------
+// Where the threads of a group run.
+// A pinned worker allocates itself on its own thread, so that its queues, timer heap
+// and block pool caches are first touched, and placed, on the worker's NUMA node.
+//-----------------------------------------
+struct PlacementSpec {
+    enum class Kind : uint8_t {
+        Unpinned,       // left to the scheduler, as before
+        CpuList,        // worker i on m_cpus[i % size]
+        OnePerCore,     // one hardware thread of each physical core
+        CompactOnNode,  // the cpus of NUMA node m_node, in order
+    };
+
+    static PlacementSpec Cpus(std::vector<int> _cpus) { return {Kind::CpuList, std::move(_cpus), 0}; }
+    static PlacementSpec OnePerPhysicalCore() { return {Kind::OnePerCore, {}, 0}; }
+    static PlacementSpec CompactOn(int _node) { return {Kind::CompactOnNode, {}, _node}; }
+
+    Kind m_kind = Kind::Unpinned;
+    std::vector<int> m_cpus;
+    int m_node = 0;
+};
+
+// the cpu of every worker, -1 where the worker stays unpinned(or pinning is unsupported)
+std::vector<int> ResolvePlacement(const PlacementSpec& _spec, unsigned _worker_count);
+// returns false if the system refused
+bool PinCurrentThread(int _cpu);
+// -1 if unknown
+int NumaNodeOfCpu(int _cpu);
+}  // namespace nd
+
+#endif /* PLACEMENT_H */
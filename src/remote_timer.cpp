@@ -0,0 +1,20 @@
+#include "remote_timer.hpp"
+
+#include "worker.hpp"
+
+using namespace nd;
+using namespace std;
+
+//-----------------------------------------------------------------------------
+
+bool RemoteTimer::Cancel() {
+    if (m_node == nullptr) { return false; }
+
+    uint32_t state = m_node->m_state.fetch_or(RemoteTimerNode::CANCELLED, std::memory_order_acq_rel);
+    bool is_cancelled = (state & (RemoteTimerNode::FIRED | RemoteTimerNode::CANCELLED)) == 0;
+    // an armed timer sits in the worker's heap, only the worker can take it out,
+    // one which is not armed yet is dropped by the worker when it comes out of the mailbox
+    if (is_cancelled && (state & RemoteTimerNode::ARMED) != 0) { m_node->m_worker->PostTimerRequest(m_node); }
+    Reset();
+    return is_cancelled;
+}
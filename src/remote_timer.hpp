@@ -0,0 +1,98 @@
+#ifndef REMOTE_TIMER_H
+#define REMOTE_TIMER_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cassert>
+#include <utility>
+
+#include "block_pool.hpp"
+#include "min_heap.h"
+#include "mpsc_queue.hpp"
+#include "timer_pool.hpp"
+
+namespace nd {
+
+class Worker;
+
+//-----------------------------------------
+// A timer requested from another thread, it travels through the owner's timer mailbox.
+// Shared by the caller's handle and the owning worker, the last one to let go frees it.
+// The state word decides the races between firing and cancelling:
+// the worker sets ARMED once the timer is in its heap(or wheel), and FIRED when it is due,
+// a canceller sets CANCELLED, and posts the node once more only if it found it armed,
+// so the node is never in the mailbox twice.
+//-----------------------------------------
+struct RemoteTimerNode : public MpscNode {
+    static constexpr uint32_t ARMED = 1;
+    static constexpr uint32_t FIRED = 2;
+    static constexpr uint32_t CANCELLED = 4;
+
+    RemoteTimerNode(Worker* _worker, CppTimePoint _deadline, uint64_t _slack_ms, TimerCallback&& _callback)
+        : m_ref_count(2),
+          m_state(0),
+          m_worker(_worker),
+          m_deadline(_deadline),
+          m_slack_ms(_slack_ms),
+          m_callback(std::move(_callback)) {}
+    RemoteTimerNode(const RemoteTimerNode&) = delete;
+    RemoteTimerNode& operator=(const RemoteTimerNode&) = delete;
+
+    void Release() {
+        if (m_ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) { delete this; }
+    }
+
+    static void* operator new(size_t _size) {
+        assert(_size == sizeof(RemoteTimerNode));
+        return BlockPool<sizeof(RemoteTimerNode)>::Allocate();
+    }
+    static void operator delete(void* _ptr) { BlockPool<sizeof(RemoteTimerNode)>::Free(_ptr); }
+
+    std::atomic<uint32_t> m_ref_count;
+    std::atomic<uint32_t> m_state;
+    Worker* m_worker;
+    CppTimePoint m_deadline;
+    uint64_t m_slack_ms;
+    TimerCallback m_callback;
+    // the owner thread only
+    TimerHandle m_timer;
+};
+
+//-----------------------------------------
+// Handle of a timer added from any thread, it may be cancelled from any thread as well.
+// Dropping the handle leaves the timer running.
+//-----------------------------------------
+class RemoteTimer {
+public:
+    RemoteTimer() : m_node(nullptr) {}
+    explicit RemoteTimer(RemoteTimerNode* _node) : m_node(_node) {}
+    RemoteTimer(RemoteTimer&& _other) noexcept : m_node(std::exchange(_other.m_node, nullptr)) {}
+    RemoteTimer& operator=(RemoteTimer&& _other) noexcept {
+        if (this != &_other) {
+            Reset();
+            m_node = std::exchange(_other.m_node, nullptr);
+        }
+        return *this;
+    }
+    RemoteTimer(const RemoteTimer&) = delete;
+    RemoteTimer& operator=(const RemoteTimer&) = delete;
+    ~RemoteTimer() { Reset(); }
+
+    explicit operator bool() const { return m_node != nullptr; }
+
+    // true if the callback will not run, false if it ran, runs or the timer was cancelled already,
+    // the handle is empty afterwards
+    bool Cancel();
+
+    // lets the timer go without cancelling it
+    void Reset() {
+        if (m_node != nullptr) { std::exchange(m_node, nullptr)->Release(); }
+    }
+
+private:
+    RemoteTimerNode* m_node;
+};
+}  // namespace nd
+
+#endif /* REMOTE_TIMER_H */
@@ -0,0 +1,106 @@
+#ifndef SESSION_ROUTER_H
+#define SESSION_ROUTER_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "worker_types.hpp"
+
+namespace nd {
+
+//-----------------------------------------
+// Maps a session to the worker which runs all its jobs.
+// A router must be stable, the same session and worker count always give the same worker,
+// that is what keeps the jobs of a session in order.
+//-----------------------------------------
+class SessionRouter {
+public:
+    virtual ~SessionRouter() {}
+    // returns a worker index in [0, _worker_count)
+    virtual unsigned Route(SessionId _session_id, unsigned _worker_count) const = 0;
+    // whether going from _old_count to _new_count workers may route a session of another worker to _worker_id,
+    // only those workers wait for the moved jobs during a resize
+    virtual bool MayGainSessions(unsigned /*_worker_id*/, unsigned /*_old_count*/, unsigned /*_new_count*/) const {
+        return true;
+    }
+};
+
+// the historical _session_id % worker count
+class ModuloRouter : public SessionRouter {
+public:
+    unsigned Route(SessionId _session_id, unsigned _worker_count) const override {
+        return _session_id % _worker_count;
+    }
+};
+
+// no division, the worker count must be a power of two
+class MaskRouter : public SessionRouter {
+public:
+    unsigned Route(SessionId _session_id, unsigned _worker_count) const override {
+        assert((_worker_count & (_worker_count - 1)) == 0);
+        return _session_id & (_worker_count - 1);
+    }
+};
+
+// mixes the id first, so that sequential or strided ids don't cluster on a few workers
+class HashRouter : public SessionRouter {
+public:
+    unsigned Route(SessionId _session_id, unsigned _worker_count) const override {
+        // multiply-shift range reduction instead of a division
+        return static_cast<unsigned>(((Mix(_session_id) >> 32) * _worker_count) >> 32);
+    }
+
+    // splitmix64 finalizer
+    static uint64_t Mix(uint64_t _key) {
+        _key = (_key ^ (_key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        _key = (_key ^ (_key >> 27)) * 0x94d049bb133111ebULL;
+        return _key ^ (_key >> 31);
+    }
+};
+
+// jump consistent hash(Lamping and Veach), growing from n to n + 1 workers moves only 1/(n + 1) of the sessions,
+// and all of them to the new worker
+class JumpHashRouter : public SessionRouter {
+public:
+    unsigned Route(SessionId _session_id, unsigned _worker_count) const override {
+        uint64_t key = _session_id;
+        int64_t bucket = -1;
+        int64_t next = 0;
+        while (next < _worker_count) {
+            bucket = next;
+            key = key * 2862933555777941757ULL + 1;
+            next = static_cast<int64_t>((bucket + 1) * (double(1LL << 31) / double((key >> 33) + 1)));
+        }
+        return static_cast<unsigned>(bucket);
+    }
+    // a grow moves sessions to the new workers only, a shrink to any of the workers left
+    bool MayGainSessions(unsigned _worker_id, unsigned _old_count, unsigned _new_count) const override {
+        return _new_count < _old_count || _worker_id >= _old_count;
+    }
+};
+
+enum class SessionRouting {
+    Modulo,
+    Mask,
+    Hash,
+    JumpHash,
+};
+
+inline std::shared_ptr<const SessionRouter> MakeSessionRouter(SessionRouting _routing) {
+    switch (_routing) {
+        case SessionRouting::Mask:
+            return std::make_shared<MaskRouter>();
+        case SessionRouting::Hash:
+            return std::make_shared<HashRouter>();
+        case SessionRouting::JumpHash:
+            return std::make_shared<JumpHashRouter>();
+        case SessionRouting::Modulo:
+        default:
+            return std::make_shared<ModuloRouter>();
+    }
+}
+}  // namespace nd
+
+#endif /* SESSION_ROUTER_H */
@@ -0,0 +1,103 @@
+#ifndef STEAL_QUEUE_H
+#define STEAL_QUEUE_H
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "worker_types.hpp"
+
+namespace nd {
+
+//-----------------------------------------
+// FIFO of jobs that carry no session, so any worker of the group may run them.
+// Producers, the owner and the thieves all touch it, a plain lock keeps it simple rather than a deque per worker,
+// the owner takes a batch and a thief half of the queue per lock,
+// the size is readable without the lock so that empty queues are never locked.
+//-----------------------------------------
+class StealQueue {
+public:
+    StealQueue() : m_head(nullptr), m_tail(nullptr), m_size(0) {}
+    StealQueue(const StealQueue&) = delete;
+    StealQueue& operator=(const StealQueue&) = delete;
+
+    size_t Size() const { return m_size.load(std::memory_order_seq_cst); }
+
+    // returns the size after the push
+    size_t Push(Job* _job) { return PushChain(_job, _job, 1); }
+
+    // [_first, _last] must be linked through m_next already
+    size_t PushChain(Job* _first, Job* _last, size_t _count) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Link(_first, _last, _count);
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    // takes the oldest _max_count jobs at most in one go
+    JobChain PopUpTo(size_t _max_count) {
+        if (Size() == 0 || _max_count == 0) { return JobChain(); }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return DetachFront(std::min(_max_count, m_size.load(std::memory_order_relaxed)));
+    }
+
+    // moves the older half(at least one) of the jobs to _thief, returns how many
+    size_t StealHalfInto(StealQueue& _thief) {
+        if (Size() == 0) { return 0; }
+
+        JobChain chain;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            chain = DetachFront((m_size.load(std::memory_order_relaxed) + 1) / 2);
+        }
+        if (chain.IsEmpty()) { return 0; }
+
+        std::lock_guard<std::mutex> lock(_thief.m_mutex);
+        _thief.Link(static_cast<Job*>(chain.m_first), static_cast<Job*>(chain.m_last), chain.m_count);
+        return chain.m_count;
+    }
+
+private:
+    static Job* Next(Job* _job) {
+        return static_cast<Job*>(static_cast<JobNode*>(_job->m_next.load(std::memory_order_relaxed)));
+    }
+
+    // with m_mutex held, _count must not exceed the size
+    JobChain DetachFront(size_t _count) {
+        JobChain chain;
+        if (_count == 0) { return chain; }
+
+        Job* last = m_head;
+        for (size_t i = 1; i < _count; i++) { last = Next(last); }
+        chain.m_first = m_head;
+        chain.m_last = last;
+        chain.m_count = _count;
+        m_head = Next(last);
+        if (m_head == nullptr) { m_tail = nullptr; }
+        last->m_next.store(nullptr, std::memory_order_relaxed);
+        m_size.fetch_sub(_count, std::memory_order_seq_cst);
+        return chain;
+    }
+
+    // with m_mutex held
+    void Link(Job* _first, Job* _last, size_t _count) {
+        _last->m_next.store(nullptr, std::memory_order_relaxed);
+        if (m_tail == nullptr) {
+            m_head = _first;
+        } else {
+            m_tail->m_next.store(_first, std::memory_order_relaxed);
+        }
+        m_tail = _last;
+        m_size.fetch_add(_count, std::memory_order_seq_cst);
+    }
+
+    std::mutex m_mutex;
+    Job* m_head;
+    Job* m_tail;
+    std::atomic<size_t> m_size;
+};
+}  // namespace nd
+
+#endif /* STEAL_QUEUE_H */
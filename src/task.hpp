@@ -1,10 +1,15 @@
+#pragma once
+
 #include <atomic>
+#include <cassert>
 #include <coroutine>
 #include <iostream>
-#include <list>
-#include <tuple>
+#include <optional>
+#include <thread>
 #include <type_traits>
+#include <utility>
 
+#include "frame_allocator.hpp"
 #include "log.hpp"
 #include "worker_manager.hpp"
 #include "worker_types.hpp"
@@ -20,340 +25,607 @@ struct Empty {};
 template <bool exists, class T>
 using Maybe = std::conditional_t<exists, T, Empty>;
 
-template <typename ReturnType>
-class BaseTask;
-
 template <typename ReturnType>
 class Task;
 
-template <typename T>
-class ID {
-public:
-    ID() : m_id(++s_id) {}
-    operator size_t() const { return m_id; }
-    size_t Id() const { return m_id; }
+template <typename ReturnType, typename FrameBase = FramePromise>
+class TaskPromise;
 
-private:
-    static std::atomic<size_t> s_id;
-    size_t m_id;
+template <typename ReturnType, bool IS_CONSUMING>
+class TimeoutAwaiter;
+
+template <bool IS_ANY>
+class TaskSetAwaiter;
+
+// a coroutine waiting for a task, embedded in its awaiter so that waiting allocates nothing,
+// it is resumed on m_worker once the task returns.
+// A combinator sets m_on_return to be called on the returning worker instead,
+// it returns the waiter to resume in its place, if any.
+struct TaskWaiter {
+    CoroutineNode m_resume_node;
+    Worker* m_worker = nullptr;
+    TaskWaiter* m_next = nullptr;
+    TaskWaiter* (*m_on_return)(TaskWaiter* _waiter) = nullptr;
+};
+
+// the result of a task, constructed in place by its co_return,
+// no default constructor needed, it is there once the task returned without an exception
+template <typename ReturnType>
+union TaskResult {
+    TaskResult() {}
+    ~TaskResult() {}
+    ReturnType m_value;
 };
-template <typename T>
-std::atomic<size_t> ID<T>::s_id = 0;
 
 //-----------------------------------------
-// Control the lifetime of the task and coroutine
-// If the return task is not holded in any where, it lives until the coroutine exits.
-// Otherwise, it lives until the last hold task is done.
+// The state of a task, the base of its promise, so that it lives in the coroutine frame.
+// Every Task handle holds a reference, and so does the coroutine from its start to its final suspend,
+// the last one to let go destroys the frame.
+// A task which is never run goes with its last handle, one which runs outlives its handles.
+// Whether it started or returned and who waits for it share one atomic word, the waiters are a lock-free stack,
+// so starting, awaiting and returning are a single CAS each in the usual case of one awaiter.
+// Nothing here depends on the result type, so that a combinator handles tasks of any type alike.
 //-----------------------------------------
-template <typename ReturnType = void>
-class CoroutineController {
+class TaskState {
 public:
-    using WaitingTask = std::tuple<BaseTask<ReturnType>*, Worker*>;
-
-    CoroutineController(std::coroutine_handle<> _coroutine) : m_coroutine(_coroutine) {
-        LOG_TRACE("controller-" << m_id << " created");
-    }
-    virtual ~CoroutineController() {
-        if (m_coroutine) {
-            m_coroutine.destroy();
-            m_coroutine = nullptr;
-        }
-        LOG_TRACE("controller-" << m_id << " destroyed");
-    }
-
-    // please make sure the handle is valid before use it
-    // it is only used in resume
-    std::coroutine_handle<> Handle() const { return m_coroutine; }
-
-    void AddWaitingTask(BaseTask<ReturnType>* _task, Worker* _worker);
-    void OnCoroutineReturn();
-    void OnCoroutineDone();
-
-    bool IsDone() {
-        std::lock_guard<std::mutex> lock(m_waiting_tasks_mutex);
-        return m_coroutine == nullptr;
-    }
-
-    template <typename CheckType = ReturnType>
-    void SaveResult(typename std::enable_if_t<!std::is_void_v<CheckType>, const ReturnType>& _value) {
-        m_result = _value;
-    };
-    template <typename CheckType = ReturnType>
-    void SaveResult(typename std::enable_if_t<!std::is_void_v<CheckType>, ReturnType>&& _value) {
-        m_result = _value;
-    };
-    template <typename CheckType = ReturnType>
-    typename std::enable_if_t<!std::is_void_v<CheckType>, const ReturnType>& GetResult() {
-        return m_result;
-    };
+    TaskState() : m_state(0), m_ref_count(1), m_has_many_waiters(false) {}
+    TaskState(const TaskState&) = delete;
+    TaskState& operator=(const TaskState&) = delete;
+
+    void AddRef() { m_ref_count.fetch_add(1, std::memory_order_relaxed); }
+    void Release();
+
+    // queues the coroutine to _worker, a task runs once, later calls do nothing
+    void Start(Worker* _worker, JobPriority _priority);
+    // takes the start for the caller, which resumes Handle() itself
+    bool TryStart();
+    std::coroutine_handle<> Handle() const { return m_resume_node.m_handle; }
+
+    // false if the coroutine has returned already, the waiter is not kept then
+    bool AddWaiter(TaskWaiter* _waiter);
+    // false if the return has taken the waiter out to resume it already
+    bool RemoveWaiter(TaskWaiter* _waiter);
+    // at the final suspend: lets go of the coroutine's own reference, queues the waiters on other workers,
+    // and returns the first one on this worker, to be resumed at once(noop_coroutine if none)
+    std::coroutine_handle<> OnCoroutineReturn();
+
+    // the coroutine has returned(or thrown), its result is ready
+    bool IsDone() const { return (m_state.load(std::memory_order_acquire) & RETURNED) != 0; }
+    // once returned, for a holder of a handle: it holds the last reference and was the only waiter, if any,
+    // so nobody else may read the result any more.
+    // false while the coroutine is still letting go of its own reference, which only costs a copy
+    bool IsSoleOwner() const { return m_ref_count.load(std::memory_order_acquire) == 1 && !m_has_many_waiters; }
 
     void SaveException(std::exception_ptr _exception) { m_exception = _exception; }
     std::exception_ptr GetException() { return m_exception; }
+    bool HasException() const { return m_exception != nullptr; }
     void CheckException() {
         if (m_exception) { std::rethrow_exception(m_exception); }
     }
 
-private:
-    ID<CoroutineController<Empty>> m_id;
+protected:
+    // queued to resume the coroutine on its worker, the promise sets the handle
+    CoroutineNode m_resume_node;
 
-    std::list<WaitingTask> m_waiting_tasks;
-    std::mutex m_waiting_tasks_mutex;
+private:
+    // the low bits of m_state, the rest is the latest waiter, which links to the earlier ones
+    static constexpr uintptr_t STARTED = 1;
+    static constexpr uintptr_t RETURNED = 2;
+    // a waiter is being taken out, the others wait for the few instructions that takes
+    static constexpr uintptr_t LOCKED = 4;
+    static constexpr uintptr_t FLAG_MASK = STARTED | RETURNED | LOCKED;
+    static_assert(alignof(TaskWaiter) > FLAG_MASK);
+
+    static TaskWaiter* WaitersOf(uintptr_t _state) { return reinterpret_cast<TaskWaiter*>(_state & ~FLAG_MASK); }
+    // the state once nobody holds LOCKED
+    uintptr_t LoadUnlocked() const {
+        uintptr_t state = m_state.load(std::memory_order_acquire);
+        while ((state & LOCKED) != 0) {
+            std::this_thread::yield();
+            state = m_state.load(std::memory_order_acquire);
+        }
+        return state;
+    }
 
-    std::coroutine_handle<> m_coroutine;
+    std::atomic<uintptr_t> m_state;
+    std::atomic<uint32_t> m_ref_count;
+    // set by the return before it lets go of the coroutine's reference, read once the count says that is done
+    bool m_has_many_waiters;
 
-    NO_UNIQUE_ADDRESS Maybe<!std::is_void_v<ReturnType>, ReturnType> m_result;
     std::exception_ptr m_exception;
 };
 
-static_assert(sizeof(CoroutineController<void>) != sizeof(CoroutineController<char>));
-
+//-----------------------------------------
+// The state of a task with its result.
+//-----------------------------------------
 template <typename ReturnType = void>
-class BaseTask {
+class CoroutineController : public TaskState {
 public:
-    friend class CoroutineController<ReturnType>;
-    using CorotineControllerSharedPtr = std::shared_ptr<CoroutineController<ReturnType>>;
-
-    BaseTask(CorotineControllerSharedPtr& _controller) : m_controller(_controller), m_running_worker(nullptr) {}
-    virtual ~BaseTask() {}
-
-    void BaseRunOnProcessor(int _worker_group_id = PreDefWorkerGroup::Current, const SessionId _the_id = 0) {
-        if (m_running_worker != nullptr) {
-            // LOG_WARN("task can't run twice");
-            return;
+    CoroutineController() = default;
+    ~CoroutineController() {
+        if constexpr (!std::is_void_v<ReturnType>) {
+            if (IsDone() && !HasException()) { m_result.m_value.~ReturnType(); }
         }
-
-        m_running_worker = g_worker_mgr->GetWorker(_worker_group_id, _the_id);
-        BaseResume();
     }
 
-    void BaseResume() {
-        if (m_running_worker == nullptr) { return; }
-
-        auto controller = m_controller;
-        auto id = m_id.Id();
-        m_running_worker->AddJob(new nd::Job{[controller, id]() {
-            if (!controller) { return; }
-            LOG_TRACE("task-" << id << " run in worker");
-            controller->Handle().resume();
-        }});
-    }
-
-    void WaitReturn(Worker* _worker) { m_controller->AddWaitingTask(this, _worker); }
-
-    virtual void OnCoroutineReturn() {}
+    // once, before the return
+    template <typename Value>
+    void SaveResult(Value&& _value) {
+        new (&m_result.m_value) ReturnType(std::forward<Value>(_value));
+    };
+    template <typename CheckType = ReturnType>
+    typename std::enable_if_t<!std::is_void_v<CheckType>, const ReturnType>& GetResult() {
+        return m_result.m_value;
+    };
+    // moves the result out, for the sole owner
+    template <typename CheckType = ReturnType>
+    typename std::enable_if_t<!std::is_void_v<CheckType>, ReturnType>&& TakeResult() {
+        return std::move(m_result.m_value);
+    };
 
-    bool IsDone() const { return m_controller->IsDone(); }
+private:
+    NO_UNIQUE_ADDRESS Maybe<!std::is_void_v<ReturnType>, TaskResult<ReturnType>> m_result;
+};
 
-protected:
-    ID<BaseTask<Empty>> m_id;
+static_assert(sizeof(CoroutineController<void>) != sizeof(CoroutineController<char>));
 
-    CorotineControllerSharedPtr m_controller;
-    nd::Worker* m_running_worker;
+// releases the coroutine's own reference and hands the result over to the waiters,
+// a waiter on the same worker goes on right here by symmetric transfer, without a queue round trip or stack growth
+template <typename Promise>
+struct TaskFinalAwaiter {
+    // NOLINTNEXTLINE
+    bool await_ready() const noexcept { return false; }
+    // NOLINTNEXTLINE
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> _coroutine) noexcept {
+        // the frame may be gone once it returns
+        return _coroutine.promise().OnCoroutineReturn();
+    }
+    // NOLINTNEXTLINE
+    void await_resume() const noexcept {}
 };
 
 //-----------------------------------------
-template <typename ReturnType>
-class TaskPromise {
+// The promise of a task, FrameBase allocates its frame,
+// the one of a coroutine passing an allocator is picked by the coroutine_traits below.
+//-----------------------------------------
+template <typename ReturnType, typename FrameBase>
+class TaskPromise : public FrameBase, public CoroutineController<ReturnType> {
 public:
-    friend class Task<ReturnType>;
-    using CorotineControllerSharedPtr = std::shared_ptr<CoroutineController<ReturnType>>;
-
     TaskPromise() noexcept {
-        LOG_TRACE("promise-" << m_id << " created");
-
-        m_controller =
-            std::make_shared<CoroutineController<ReturnType>>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+        LOG_TRACE("promise-" << this << " created");
+        this->m_resume_node.m_handle = std::coroutine_handle<TaskPromise>::from_promise(*this);
     }
-    virtual ~TaskPromise() { LOG_TRACE("promise-" << m_id << " destroyed"); }
+    ~TaskPromise() { LOG_TRACE("promise-" << this << " destroyed"); }
 
     // NOLINTNEXTLINE
-    auto initial_suspend() noexcept {
-        LOG_TRACE("promise-" << m_id << " inital_suspend");
-        return std::suspend_always{};
-    }
+    auto initial_suspend() noexcept { return std::suspend_always{}; }
 
     // NOLINTNEXTLINE
     auto final_suspend() noexcept {
-        LOG_TRACE("promise-" << m_id << " final_suspend");
-        m_controller->OnCoroutineDone();
-        return std::suspend_never{};
+        LOG_TRACE("promise-" << this << " final_suspend");
+        return TaskFinalAwaiter<TaskPromise>{};
     }
 
     // NOLINTNEXTLINE
-    Task<ReturnType> get_return_object() noexcept;
+    Task<ReturnType> get_return_object() noexcept { return Task<ReturnType>(this); }
 
+    // a copy or move which throws ends up in unhandled_exception()
     // NOLINTNEXTLINE
-    void return_value(const ReturnType& _value) noexcept {
-        LOG_TRACE("promise-" << m_id << " return value&");
-        m_controller->SaveResult(_value);
-        m_controller->OnCoroutineReturn();
+    void return_value(const ReturnType& _value) {
+        LOG_TRACE("promise-" << this << " return value&");
+        this->SaveResult(_value);
     }
 
     // NOLINTNEXTLINE
-    void return_value(ReturnType&& _value) noexcept {
-        LOG_TRACE("promise-" << m_id << " return value&&");
-        m_controller->SaveResult(_value);
-        m_controller->OnCoroutineReturn();
+    void return_value(ReturnType&& _value) {
+        LOG_TRACE("promise-" << this << " return value&&");
+        this->SaveResult(std::move(_value));
     }
 
     // NOLINTNEXTLINE
     void unhandled_exception() noexcept {
-        LOG_TRACE("promise-" << m_id << " unhandled exception");
-        m_controller->SaveException(std::current_exception());
-        m_controller->OnCoroutineReturn();
+        LOG_TRACE("promise-" << this << " unhandled exception");
+        this->SaveException(std::current_exception());
     }
-
-private:
-    CorotineControllerSharedPtr m_controller;
-    ID<TaskPromise<Empty>> m_id;
 };
 
 // It is illegal to have both return_value and return_void in a promise type, even if
 // one of them is removed by SFINAE
 // https://devblogs.microsoft.com/oldnewthing/20210330-00/?p=105019
-template <>
-class TaskPromise<void> {
+template <typename FrameBase>
+class TaskPromise<void, FrameBase> : public FrameBase, public CoroutineController<void> {
 public:
-    friend class Task<void>;
-    using CorotineControllerSharedPtr = std::shared_ptr<CoroutineController<void>>;
-
     TaskPromise() noexcept {
-        LOG_TRACE("promise-" << m_id << " created");
-
-        m_controller =
-            std::make_shared<CoroutineController<void>>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+        LOG_TRACE("promise-" << this << " created");
+        m_resume_node.m_handle = std::coroutine_handle<TaskPromise>::from_promise(*this);
     }
-    virtual ~TaskPromise() { LOG_TRACE("promise-" << m_id << " destroyed"); }
+    ~TaskPromise() { LOG_TRACE("promise-" << this << " destroyed"); }
 
     // NOLINTNEXTLINE
-    auto initial_suspend() noexcept {
-        LOG_TRACE("promise-" << m_id << " inital_suspend");
-        return std::suspend_always{};
-    }
+    auto initial_suspend() noexcept { return std::suspend_always{}; }
 
     // NOLINTNEXTLINE
     auto final_suspend() noexcept {
-        LOG_TRACE("promise-" << m_id << " final_suspend");
-        m_controller->OnCoroutineDone();
-        return std::suspend_never{};
+        LOG_TRACE("promise-" << this << " final_suspend");
+        return TaskFinalAwaiter<TaskPromise>{};
     }
 
     // NOLINTNEXTLINE
     Task<void> get_return_object() noexcept;
 
     // NOLINTNEXTLINE
-    void return_void() noexcept {
-        LOG_TRACE("promise-" << m_id << " return void");
-        m_controller->OnCoroutineReturn();
-    }
+    void return_void() noexcept { LOG_TRACE("promise-" << this << " return void"); }
 
     // NOLINTNEXTLINE
     void unhandled_exception() noexcept {
-        LOG_TRACE("promise-" << m_id << " unhandled exception");
-        m_controller->SaveException(std::current_exception());
-        m_controller->OnCoroutineReturn();
+        LOG_TRACE("promise-" << this << " unhandled exception");
+        SaveException(std::current_exception());
     }
+};
 
-private:
-    CorotineControllerSharedPtr m_controller;
-    ID<TaskPromise<Empty>> m_id;
+//-----------------------------------------
+// co_await task, each awaiter waits with its own node, so any number of coroutines may await a task.
+// It gives a reference to the result kept in the frame,
+// the consuming one(co_await std::move(task), or of a temporary task) gives the result by value:
+// moved out when its handle is the last one and it was the only awaiter, the usual case, copied otherwise.
+// A move-only result is moved out regardless, no other handle may read it then.
+//-----------------------------------------
+template <typename ReturnType, bool IS_CONSUMING = false>
+class TaskAwaiter {
+public:
+    using ResumeType = std::conditional_t<IS_CONSUMING, ReturnType, std::add_lvalue_reference_t<const ReturnType>>;
+
+    explicit TaskAwaiter(CoroutineController<ReturnType>* _promise) : m_promise(_promise) {}
+    TaskAwaiter(const TaskAwaiter&) = delete;
+    TaskAwaiter& operator=(const TaskAwaiter&) = delete;
+
+    // NOLINTNEXTLINE
+    bool await_ready() const noexcept { return m_promise->IsDone(); }
+    // NOLINTNEXTLINE
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> _awaiting_coroutine) noexcept {
+        m_waiter.m_resume_node.m_handle = _awaiting_coroutine;
+        m_waiter.m_worker = Worker::GetCurrentWorker();
+        // returned in the meantime, go on at once
+        if (!m_promise->AddWaiter(&m_waiter)) { return _awaiting_coroutine; }
+        // a task nobody started runs here and now, and comes back the same way
+        if (m_promise->TryStart()) { return m_promise->Handle(); }
+        return std::noop_coroutine();
+    }
+
+    template <typename CheckType = ReturnType>  // NOLINTNEXTLINE
+    typename std::enable_if_t<std::is_void_v<CheckType>, void> await_resume() const {
+        m_promise->CheckException();
+    }
+
+    template <typename CheckType = ReturnType>  // NOLINTNEXTLINE
+    typename std::enable_if_t<!std::is_void_v<CheckType>, ResumeType> await_resume() const {
+        m_promise->CheckException();
+        if constexpr (IS_CONSUMING) {
+            if constexpr (std::is_copy_constructible_v<ReturnType>) {
+                if (!m_promise->IsSoleOwner()) { return m_promise->GetResult(); }
+            }
+            return m_promise->TakeResult();
+        } else {
+            return m_promise->GetResult();
+        }
+    }
+
+protected:
+    CoroutineController<ReturnType>* m_promise;
+    TaskWaiter m_waiter;
 };
 
+//-----------------------------------------
+// The handle of a task, a single counted pointer to its promise.
+// A copy shares the coroutine.
+//-----------------------------------------
 template <typename ReturnType = void>
-class Task : public BaseTask<ReturnType> {
+class Task {
 public:
+    // of a coroutine without an allocator, std::coroutine_traits picks the promise
     using promise_type = TaskPromise<ReturnType>;  // NOLINT
-    using CorotineControllerSharedPtr = std::shared_ptr<CoroutineController<ReturnType>>;
-    using ParentTask = BaseTask<ReturnType>;
 
-    Task(CorotineControllerSharedPtr& _controller) : ParentTask(_controller) {
-        LOG_TRACE("task-" << ParentTask::m_id << " created");
+    Task() : m_promise(nullptr) {}
+    // takes over the reference the promise starts with
+    explicit Task(CoroutineController<ReturnType>* _promise) : m_promise(_promise) {}
+    Task(const Task& _other) : m_promise(_other.m_promise) {
+        if (m_promise != nullptr) { m_promise->AddRef(); }
     }
-    virtual ~Task() { LOG_TRACE("task-" << ParentTask::m_id << " destroyed"); }
-
-    Task& RunOnProcessor(int _worker_group_id = PreDefWorkerGroup::Current, const SessionId _the_id = 0) {
-        ParentTask::BaseRunOnProcessor(_worker_group_id, _the_id);
+    Task(Task&& _other) noexcept : m_promise(std::exchange(_other.m_promise, nullptr)) {}
+    Task& operator=(Task _other) noexcept {
+        std::swap(m_promise, _other.m_promise);
         return *this;
     }
-
-    // NOLINTNEXTLINE
-    bool await_ready() const noexcept { return ParentTask::IsDone(); }
-    // NOLINTNEXTLINE
-    void await_suspend(std::coroutine_handle<> _awaiting_coroutine) noexcept {
-        m_parent_coroutine_controller = _awaiting_coroutine;
-        ParentTask::WaitReturn(Worker::GetCurrentWorker());
+    ~Task() {
+        if (m_promise != nullptr) { m_promise->Release(); }
     }
-    virtual void OnCoroutineReturn() override {
-        ParentTask::OnCoroutineReturn();
 
-        m_parent_coroutine_controller.resume();
+    // starting a task admits new work, so it is queued as normal by default,
+    // its later resumes are continuations and go high
+    Task& RunOnProcessor(int _worker_group_id = PreDefWorkerGroup::Current,
+                         const SessionId _the_id = 0,
+                         JobPriority _priority = JobPriority::Normal) {
+        m_promise->Start(g_worker_mgr->GetWorker(_worker_group_id, _the_id), _priority);
+        return *this;
     }
 
-    template <typename CheckType = ReturnType>  // NOLINTNEXTLINE
-    typename std::enable_if_t<std::is_void_v<CheckType>, void> await_resume() const {
-        LOG_TRACE("task-" << ParentTask::m_id << " return void");
-        ParentTask::m_controller->CheckException();
-    }
+    bool IsDone() const { return m_promise->IsDone(); }
 
-    template <typename CheckType = ReturnType>  // NOLINTNEXTLINE
-    typename std::enable_if_t<!std::is_void_v<CheckType>, const CheckType>& await_resume() const {
-        LOG_TRACE("task-" << ParentTask::m_id << " return value&");
-        ParentTask::m_controller->CheckException();
-        return ParentTask::m_controller->GetResult();
+    TaskAwaiter<ReturnType> operator co_await() const& { return TaskAwaiter<ReturnType>(m_promise); }
+    // the result is moved out, a temporary task lives on until the end of the co_await expression
+    TaskAwaiter<ReturnType, true> operator co_await() && { return TaskAwaiter<ReturnType, true>(m_promise); }
+
+    // awaits the task for at most _ms_time, the timer runs on the awaiting worker,
+    // on timeout a late return is dropped and the task runs on by itself
+    TimeoutAwaiter<ReturnType, false> WithTimeout(uint64_t _ms_time, uint64_t _slack_ms = DEFAULT_TIMER_SLACK) const& {
+        return WithDeadline(DeadlineIn(_ms_time), _slack_ms);
+    }
+    TimeoutAwaiter<ReturnType, true> WithTimeout(uint64_t _ms_time, uint64_t _slack_ms = DEFAULT_TIMER_SLACK) && {
+        return std::move(*this).WithDeadline(DeadlineIn(_ms_time), _slack_ms);
+    }
+    // the same with a LoopClock deadline
+    TimeoutAwaiter<ReturnType, false> WithDeadline(CppTimePoint _deadline,
+                                                   uint64_t _slack_ms = DEFAULT_TIMER_SLACK) const& {
+        return TimeoutAwaiter<ReturnType, false>(m_promise, _deadline, _slack_ms);
+    }
+    TimeoutAwaiter<ReturnType, true> WithDeadline(CppTimePoint _deadline, uint64_t _slack_ms = DEFAULT_TIMER_SLACK) && {
+        return TimeoutAwaiter<ReturnType, true>(m_promise, _deadline, _slack_ms);
     }
 
     // wait for the task to complete in main thread
     void WaitInMain() {
-        while (!ParentTask::IsDone()) { Worker::GetCurrentWorker()->Step(); }
+        if (IsDone()) { return; }
+
+        // the worker sleeps in Step() until a job comes, so have the return post one,
+        // the job sets the flag on this thread, after which the returning worker is done with the waiter
+        struct MainWaiter : TaskWaiter {
+            bool m_is_resumed = false;
+        };
+        MainWaiter waiter;
+        waiter.m_worker = Worker::GetCurrentWorker();
+        waiter.m_on_return = [](TaskWaiter* _waiter) -> TaskWaiter* {
+            auto* main_waiter = static_cast<MainWaiter*>(_waiter);
+            main_waiter->m_worker->AddJob([main_waiter]() { main_waiter->m_is_resumed = true; }, JobPriority::High);
+            return nullptr;
+        };
+        if (!m_promise->AddWaiter(&waiter)) { return; }
+        while (!waiter.m_is_resumed) { waiter.m_worker->Step(); }
     }
 
 private:
-    std::coroutine_handle<> m_parent_coroutine_controller;
+    // WhenAll/WhenAny wait on the state itself
+    template <bool IS_ANY>
+    friend class TaskSetAwaiter;
+
+    static CppTimePoint DeadlineIn(uint64_t _ms_time) {
+        return Worker::GetCurrentWorker()->GetLoopTime() + std::chrono::milliseconds(_ms_time);
+    }
+
+    CoroutineController<ReturnType>* m_promise;
 };
 
+//-----------------------------------------
+// What awaiting a task with a deadline gives, the result of the task or a timeout.
+// An exception of the task is rethrown by the co_await as usual.
+//-----------------------------------------
 template <typename ReturnType>
-void CoroutineController<ReturnType>::AddWaitingTask(BaseTask<ReturnType>* _task, Worker* _worker) {
-    if (IsDone()) {
-        _worker->AddJob(new nd::Job{[_task]() { _task->OnCoroutineReturn(); }});
-        return;
+class TimeoutResult {
+public:
+    // a timeout
+    TimeoutResult() = default;
+    explicit TimeoutResult(const ReturnType& _value) : m_value(_value) {}
+    explicit TimeoutResult(ReturnType&& _value) : m_value(std::move(_value)) {}
+
+    bool IsTimeout() const { return !m_value.has_value(); }
+    explicit operator bool() const { return !IsTimeout(); }
+
+    const ReturnType& Value() const& {
+        assert(!IsTimeout());
+        return *m_value;
     }
-    std::lock_guard<std::mutex> lock(m_waiting_tasks_mutex);
-    if (m_coroutine == nullptr) {
-        _worker->AddJob(new nd::Job{[_task]() { _task->OnCoroutineReturn(); }});
+    // std::move(result).Value() takes the value out
+    ReturnType&& Value() && {
+        assert(!IsTimeout());
+        return std::move(*m_value);
+    }
+    const ReturnType& operator*() const& { return Value(); }
+    ReturnType&& operator*() && { return std::move(*this).Value(); }
+    const ReturnType* operator->() const { return &Value(); }
+
+private:
+    std::optional<ReturnType> m_value;
+};
+
+template <>
+class TimeoutResult<void> {
+public:
+    explicit TimeoutResult(bool _is_timeout) : m_is_timeout(_is_timeout) {}
+
+    bool IsTimeout() const { return m_is_timeout; }
+    explicit operator bool() const { return !IsTimeout(); }
+
+private:
+    bool m_is_timeout;
+};
+
+//-----------------------------------------
+// co_await task.WithTimeout(ms), races the return of the task against a local timer of the awaiting worker.
+// Both sides resume the coroutine on that worker, the one which takes the waiter out of the task wins,
+// so a late return finds no waiter to resume and the awaiter leaves nothing behind.
+//-----------------------------------------
+template <typename ReturnType, bool IS_CONSUMING>
+class TimeoutAwaiter : public TaskAwaiter<ReturnType, IS_CONSUMING> {
+public:
+    using ParentAwaiter = TaskAwaiter<ReturnType, IS_CONSUMING>;
+
+    TimeoutAwaiter(CoroutineController<ReturnType>* _promise, CppTimePoint _deadline, uint64_t _slack_ms)
+        : ParentAwaiter(_promise), m_deadline(_deadline), m_slack_ms(_slack_ms), m_is_timeout(false) {}
+    // the awaiting coroutine destroyed while suspended
+    ~TimeoutAwaiter() {
+        if (m_timer_handle != nullptr) {
+            Worker::GetCurrentWorker()->CancelLocalTimer(m_timer_handle);
+            ParentAwaiter::m_promise->RemoveWaiter(&this->m_waiter);
+        }
+    }
+
+    // NOLINTNEXTLINE
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> _awaiting_coroutine) noexcept {
+        std::coroutine_handle<> next = ParentAwaiter::await_suspend(_awaiting_coroutine);
+        if (next == _awaiting_coroutine) { return next; }
+
+        // the return resumes us on this worker, after the timer is set whichever way it comes
+        m_timer_handle = this->m_waiter.m_worker->AddLocalTimerAt(m_deadline, [this]() { OnTimeout(); }, m_slack_ms);
+        return next;
+    }
+
+    // NOLINTNEXTLINE
+    TimeoutResult<ReturnType> await_resume() {
+        if (m_timer_handle != nullptr) { Worker::GetCurrentWorker()->CancelLocalTimer(m_timer_handle); }
+        if constexpr (std::is_void_v<ReturnType>) {
+            if (!m_is_timeout) { ParentAwaiter::await_resume(); }
+            return TimeoutResult<void>(m_is_timeout);
+        } else {
+            if (m_is_timeout) { return TimeoutResult<ReturnType>(); }
+            return TimeoutResult<ReturnType>(ParentAwaiter::await_resume());
+        }
+    }
+
+private:
+    void OnTimeout() {
+        m_timer_handle = nullptr;
+        // the return has queued the continuation already, it resumes with the result
+        if (!ParentAwaiter::m_promise->RemoveWaiter(&this->m_waiter)) { return; }
+
+        m_is_timeout = true;
+        this->m_waiter.m_resume_node.m_handle.resume();
+    }
+
+    CppTimePoint m_deadline;
+    uint64_t m_slack_ms;
+    bool m_is_timeout;
+    TimerHandle m_timer_handle;
+};
+
+inline void TaskState::Release() {
+    if (m_ref_count.fetch_sub(1, std::memory_order_acq_rel) != 1) { return; }
+
+    // the handle set by the promise is the frame's own
+    m_resume_node.m_handle.destroy();
+}
+
+inline void TaskState::Start(Worker* _worker, JobPriority _priority) {
+    if (!TryStart()) {
+        // LOG_WARN("task can't run twice");
         return;
     }
-    m_waiting_tasks.emplace_back(_task, _worker);
+
+    LOG_TRACE("promise-" << this << " resume in worker");
+    _worker->AddResume(&m_resume_node, _priority);
 }
 
-template <typename ReturnType>
-void CoroutineController<ReturnType>::OnCoroutineReturn() {
-    // task is waited in other coroutine, so it ought to be exist
-    std::lock_guard<std::mutex> lock(m_waiting_tasks_mutex);
-    for (auto& waiting_task : m_waiting_tasks) {
-        auto* task = std::get<0>(waiting_task);
-        auto* worker = std::get<1>(waiting_task);
-        worker->AddJob(new nd::Job{[task]() { task->OnCoroutineReturn(); }});
-    }
-    m_waiting_tasks.clear();
+inline bool TaskState::TryStart() {
+    // a plain load first, the line of a running task belongs to its worker
+    if ((m_state.load(std::memory_order_relaxed) & STARTED) != 0) { return false; }
+    if ((m_state.fetch_or(STARTED, std::memory_order_relaxed) & STARTED) != 0) { return false; }
+
+    // the coroutine's own, released at its final suspend
+    AddRef();
+    return true;
 }
 
-template <typename ReturnType>
-void CoroutineController<ReturnType>::OnCoroutineDone() {
-    std::lock_guard<std::mutex> lock(m_waiting_tasks_mutex);
-    if (m_coroutine) {
-        // m_coroutine.destroy();
-        m_coroutine = nullptr;
+inline bool TaskState::AddWaiter(TaskWaiter* _waiter) {
+    uintptr_t state = LoadUnlocked();
+    while (true) {
+        if ((state & RETURNED) != 0) { return false; }
+        if ((state & LOCKED) != 0) {
+            state = LoadUnlocked();
+            continue;
+        }
+
+        _waiter->m_next = WaitersOf(state);
+        uintptr_t new_state = reinterpret_cast<uintptr_t>(_waiter) | (state & STARTED);
+        if (m_state.compare_exchange_weak(state, new_state, std::memory_order_release, std::memory_order_acquire)) {
+            return true;
+        }
     }
 }
 
-template <typename ReturnType>
-Task<ReturnType> TaskPromise<ReturnType>::get_return_object() noexcept {
-    LOG_TRACE("promise-" << m_id << " get_return_object");
-    return Task<ReturnType>{m_controller};
+inline bool TaskState::RemoveWaiter(TaskWaiter* _waiter) {
+    // only a timeout or WhenAny letting go of its losers takes a waiter out, so it may lock out the others for the walk
+    uintptr_t state = LoadUnlocked();
+    while (true) {
+        if ((state & RETURNED) != 0) { return false; }
+        if ((state & LOCKED) != 0) {
+            state = LoadUnlocked();
+            continue;
+        }
+        if (m_state.compare_exchange_weak(state, state | LOCKED, std::memory_order_acquire)) { break; }
+    }
+
+    TaskWaiter* head = WaitersOf(state);
+    bool is_found = false;
+    for (TaskWaiter** link = &head; *link != nullptr; link = &(*link)->m_next) {
+        if (*link == _waiter) {
+            *link = _waiter->m_next;
+            is_found = true;
+            break;
+        }
+    }
+    m_state.store(reinterpret_cast<uintptr_t>(head) | (state & STARTED), std::memory_order_release);
+    return is_found;
 }
 
-inline Task<void> TaskPromise<void>::get_return_object() noexcept {
-    LOG_TRACE("promise-" << m_id << " get_return_object");
-    return Task<void>{m_controller};
+inline std::coroutine_handle<> TaskState::OnCoroutineReturn() {
+    uintptr_t state = LoadUnlocked();
+    while (true) {
+        if ((state & LOCKED) != 0) {
+            state = LoadUnlocked();
+            continue;
+        }
+        // publishes the result along
+        if (m_state.compare_exchange_weak(state, (state & STARTED) | RETURNED, std::memory_order_acq_rel)) { break; }
+    }
+
+    // back to their order
+    TaskWaiter* waiters = nullptr;
+    TaskWaiter* waiter = WaitersOf(state);
+    size_t waiter_count = 0;
+    while (waiter != nullptr) {
+        TaskWaiter* next = waiter->m_next;
+        waiter->m_next = waiters;
+        waiters = waiter;
+        waiter = next;
+        waiter_count++;
+    }
+    m_has_many_waiters = waiter_count > 1;
+    // before any waiter goes on, so that a lone one finds its handle the last,
+    // every waiter comes with a handle of its own, the frame goes now only if nobody waits
+    Release();
+
+    Worker* current_worker = Worker::GetCurrentWorker();
+    std::coroutine_handle<> inline_resume = nullptr;
+    while (waiters != nullptr) {
+        // a resumed waiter may be gone at once
+        TaskWaiter* next = waiters->m_next;
+        TaskWaiter* resumed = waiters->m_on_return == nullptr ? waiters : waiters->m_on_return(waiters);
+        waiters = next;
+        if (resumed == nullptr) { continue; }
+
+        if (inline_resume == nullptr && current_worker != nullptr && resumed->m_worker == current_worker) {
+            inline_resume = resumed->m_resume_node.m_handle;
+        } else {
+            resumed->m_worker->AddResume(&resumed->m_resume_node);
+        }
+    }
+    return inline_resume != nullptr ? inline_resume : std::noop_coroutine();
 }
+
+template <typename FrameBase>
+Task<void> TaskPromise<void, FrameBase>::get_return_object() noexcept { return Task<void>(this); }
 }  // namespace nd
+
+// a task whose coroutine passes std::allocator_arg, alloc, ... gets a promise taking its frame from alloc
+template <typename ReturnType, typename... Params>
+struct std::coroutine_traits<nd::Task<ReturnType>, Params...> {
+    using promise_type = nd::TaskPromise<ReturnType, nd::FramePromiseOf<Params...>>;  // NOLINT
+};
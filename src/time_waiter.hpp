@@ -7,10 +7,11 @@
 namespace nd {
 
 // suspend coroutine for a specified time in millisecond
-// run in the same thread with the coroutine
+// run in the same thread with the coroutine, it may resume up to _slack_ms later
 class TimeWaiter {
 public:
-    TimeWaiter(uint64_t _millisecond) : m_mstime(_millisecond), m_timer_handle(nullptr) {}
+    TimeWaiter(uint64_t _millisecond, uint64_t _slack_ms = DEFAULT_TIMER_SLACK)
+        : m_mstime(_millisecond), m_slack_ms(_slack_ms), m_timer_handle(nullptr) {}
     virtual ~TimeWaiter() { Reset(); }
 
     TimeWaiter& Reset(uint64_t _time = 0) {
@@ -31,7 +32,7 @@ public:
                 m_coroutine = nullptr;
                 coroutine.resume();
             }
-        });
+        }, m_slack_ms);
         return false;
     }
 
@@ -43,6 +44,7 @@ public:
 
 private:
     uint64_t m_mstime;
+    uint64_t m_slack_ms;
     TimerHandle m_timer_handle;
     std::coroutine_handle<> m_coroutine;
 };
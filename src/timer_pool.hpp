@@ -0,0 +1,96 @@
+#ifndef TIMER_POOL_H
+#define TIMER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "min_heap.h"
+
+namespace nd {
+
+class TimerPool;
+
+//-----------------------------------------
+// Refers to a timer of a worker.
+// It remembers the generation of its slot, so once the timer fired or was cancelled
+// and the slot went to another timer, the handle is stale and cancelling it does nothing.
+// It remembers the pool of the owning worker as well, only that worker may cancel it.
+//-----------------------------------------
+class TimerHandle {
+public:
+    TimerHandle() : m_entry(nullptr), m_pool(nullptr), m_generation(0) {}
+    TimerHandle(std::nullptr_t) : TimerHandle() {}
+    TimerHandle(min_heap_item_t* _entry, const TimerPool* _pool)
+        : m_entry(_entry), m_pool(_pool), m_generation(_entry->generation) {}
+
+    // the entry while the timer is pending, nullptr once it is gone
+    min_heap_item_t* Get() const {
+        return m_entry != nullptr && m_entry->generation == m_generation ? m_entry : nullptr;
+    }
+
+    bool IsOf(const TimerPool* _pool) const { return m_pool == _pool; }
+
+    explicit operator bool() const { return m_entry != nullptr; }
+    bool operator==(std::nullptr_t) const { return m_entry == nullptr; }
+    bool operator==(const TimerHandle& _other) const = default;
+
+private:
+    min_heap_item_t* m_entry;
+    const TimerPool* m_pool;
+    uint32_t m_generation;
+};
+
+//-----------------------------------------
+// Slab of timer entries owned by one worker.
+// Entries are carved by chunks and recycled through a free list, with their callback destroyed,
+// the memory only goes back with the pool, which keeps the generation check of a stale handle safe.
+//-----------------------------------------
+class TimerPool {
+public:
+    static constexpr size_t CHUNK_SIZE = 256;
+
+    TimerPool() : m_free_list(nullptr), m_used_count(0) {}
+    TimerPool(const TimerPool&) = delete;
+    TimerPool& operator=(const TimerPool&) = delete;
+
+    min_heap_item_t* Allocate() {
+        if (m_free_list == nullptr) { Carve(); }
+        min_heap_item_t* entry = m_free_list;
+        m_free_list = entry->next_free;
+        entry->next_free = nullptr;
+        m_used_count++;
+        return entry;
+    }
+
+    void Free(min_heap_item_t* _entry) {
+        _entry->callback.Reset();
+        _entry->min_heap_idx = -1;
+        _entry->generation++;
+        _entry->next_free = m_free_list;
+        m_free_list = _entry;
+        m_used_count--;
+    }
+
+    size_t GetUsedCount() const { return m_used_count; }
+
+private:
+    void Carve() {
+        m_chunks.emplace_back(new min_heap_item_t[CHUNK_SIZE]);
+        min_heap_item_t* chunk = m_chunks.back().get();
+        for (size_t i = CHUNK_SIZE; i > 0; i--) {
+            chunk[i - 1].next_free = m_free_list;
+            m_free_list = &chunk[i - 1];
+        }
+    }
+
+    std::vector<std::unique_ptr<min_heap_item_t[]>> m_chunks;
+    min_heap_item_t* m_free_list;
+    size_t m_used_count;
+};
+}  // namespace nd
+
+#endif /* TIMER_POOL_H */
@@ -0,0 +1,204 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+#include "loop_clock.hpp"
+#include "min_heap.h"
+#include "mylist.h"
+
+namespace nd {
+
+//-----------------------------------------
+// Hierarchical timing wheel with 1 ms ticks(the Linux kernel layout).
+// The near level holds one slot per tick for the next 256 ticks,
+// each far level 64 slots covering 64 times the span of the level below,
+// a far slot is cascaded down once the near level wraps around to it.
+// Add and cancel are O(1), the due timers are taken by whole slots.
+// A deadline is rounded up to its tick, so a timer never fires early and at most a tick late.
+// A bitmap of the near slots lets the walk jump over the empty ones.
+// Owned by one thread, no locking.
+//-----------------------------------------
+class TimerWheel {
+public:
+    static constexpr unsigned NEAR_BITS = 8;
+    static constexpr unsigned FAR_BITS = 6;
+    static constexpr unsigned FAR_LEVEL_COUNT = 4;
+    static constexpr size_t NEAR_SIZE = size_t(1) << NEAR_BITS;
+    static constexpr size_t FAR_SIZE = size_t(1) << FAR_BITS;
+    static constexpr size_t NEAR_WORD_COUNT = NEAR_SIZE / 64;
+    // about 49 days, farther timers wait in the last slot and are placed again when it cascades
+    static constexpr uint64_t MAX_SPAN = uint64_t(1) << (NEAR_BITS + FAR_BITS * FAR_LEVEL_COUNT);
+
+    explicit TimerWheel(CppTimePoint _start = LoopClock::Now())
+        : m_start(_start), m_current_tick(0), m_size(0), m_near_bits{} {
+        for (auto& slot : m_near) { INIT_LIST_HEAD(&slot); }
+        for (auto& level : m_far) {
+            for (auto& slot : level) { INIT_LIST_HEAD(&slot); }
+        }
+        INIT_LIST_HEAD(&m_expired);
+    }
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    bool IsEmpty() const { return m_size == 0; }
+    // the expired timers not taken yet included
+    size_t Size() const { return m_size; }
+
+    // _timer->timeout must be set
+    void Add(min_heap_item_t* _timer) {
+        _timer->wheel_tick = TickOf(_timer->timeout, true);
+        _timer->wheel_link.item = _timer;
+        Place(_timer);
+        m_size++;
+    }
+
+    // a timer still in the wheel, or expired but not taken yet
+    void Remove(min_heap_item_t* _timer) {
+        list_del_init(&_timer->wheel_link.node);
+        m_size--;
+    }
+
+    // moves the timers due by _now to the expired list, in deadline order
+    void Expire(CppTimePoint _now) {
+        uint64_t now_tick = TickOf(_now, false);
+        while (m_current_tick <= now_tick) {
+            if (m_size == 0) {
+                // nothing to walk through
+                m_current_tick = now_tick + 1;
+                break;
+            }
+
+            size_t index = m_current_tick & (NEAR_SIZE - 1);
+            // the near level wrapped around, bring the next span of each level down
+            for (unsigned level = 0; index == 0 && level < FAR_LEVEL_COUNT; level++) {
+                size_t far_index = (m_current_tick >> (NEAR_BITS + FAR_BITS * level)) & (FAR_SIZE - 1);
+                Cascade(level, far_index);
+                if (far_index != 0) { break; }
+            }
+
+            // straight to the next occupied slot, or to the end of the round
+            size_t next_index = NextNearSlot(index);
+            uint64_t next_tick = m_current_tick + (next_index - index);
+            if (next_tick > now_tick) {
+                m_current_tick = now_tick + 1;
+                break;
+            }
+            m_current_tick = next_tick;
+            if (next_index == NEAR_SIZE) { continue; }
+
+            m_near_bits[next_index / 64] &= ~(uint64_t(1) << (next_index % 64));
+            list_splice_tail(&m_near[next_index], &m_expired);
+            INIT_LIST_HEAD(&m_near[next_index]);
+            m_current_tick++;
+        }
+    }
+
+    // the next expired timer, nullptr once they are all taken
+    min_heap_item_t* PopExpired() {
+        if (list_empty(&m_expired)) { return nullptr; }
+        min_heap_item_t* timer = reinterpret_cast<timer_wheel_link_t*>(m_expired.next)->item;
+        Remove(timer);
+        return timer;
+    }
+
+    // exact for the near level, a far timer counts from the cascade of its slot, false if there is no timer
+    bool GetNextDeadline(CppTimePoint& _deadline) {
+        if (m_size == 0) { return false; }
+        if (!list_empty(&m_expired)) {
+            _deadline = m_start;
+            return true;
+        }
+
+        uint64_t tick = UINT64_MAX;
+        size_t index = m_current_tick & (NEAR_SIZE - 1);
+        for (size_t offset = 0; offset < NEAR_SIZE; offset++) {
+            if (!list_empty(&m_near[(index + offset) & (NEAR_SIZE - 1)])) {
+                tick = m_current_tick + offset;
+                break;
+            }
+        }
+        for (unsigned level = 0; level < FAR_LEVEL_COUNT; level++) {
+            unsigned shift = NEAR_BITS + FAR_BITS * level;
+            uint64_t span = m_current_tick >> shift;
+            // the slot of the current span is cascaded already, unless the span starts right now
+            bool is_span_start = (m_current_tick & ((uint64_t(1) << shift) - 1)) == 0;
+            for (size_t offset = is_span_start ? 0 : 1; offset < FAR_SIZE + (is_span_start ? 0 : 1); offset++) {
+                if (!list_empty(&m_far[level][(span + offset) & (FAR_SIZE - 1)])) {
+                    tick = std::min(tick, (span + offset) << shift);
+                    break;
+                }
+            }
+        }
+        _deadline = m_start + std::chrono::milliseconds(tick);
+        return true;
+    }
+
+private:
+    // rounded up for a deadline, so that it does not fire early, down for the current time
+    uint64_t TickOf(CppTimePoint _time, bool _is_deadline) const {
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(_time - m_start).count();
+        if (ns <= 0) { return 0; }
+        constexpr int64_t NANOSECONDS_PER_TICK = 1000000;
+        return (ns + (_is_deadline ? NANOSECONDS_PER_TICK - 1 : 0)) / NANOSECONDS_PER_TICK;
+    }
+
+    void Place(min_heap_item_t* _timer) {
+        // a past deadline goes to the next tick to be walked
+        uint64_t tick = std::max(_timer->wheel_tick, m_current_tick);
+        uint64_t delta = tick - m_current_tick;
+        list_head* slot = nullptr;
+        if (delta < NEAR_SIZE) {
+            size_t index = tick & (NEAR_SIZE - 1);
+            m_near_bits[index / 64] |= uint64_t(1) << (index % 64);
+            slot = &m_near[index];
+        } else {
+            if (delta >= MAX_SPAN) { tick = m_current_tick + MAX_SPAN - 1; }
+            unsigned level = 0;
+            while (level + 1 < FAR_LEVEL_COUNT && delta >= (uint64_t(1) << (NEAR_BITS + FAR_BITS * (level + 1)))) {
+                level++;
+            }
+            slot = &m_far[level][(tick >> (NEAR_BITS + FAR_BITS * level)) & (FAR_SIZE - 1)];
+        }
+        list_add_tail(&_timer->wheel_link.node, slot);
+    }
+
+    // NEAR_SIZE if no slot from _index on is marked, a cancelled timer may leave a stale mark
+    size_t NextNearSlot(size_t _index) const {
+        for (size_t word = _index / 64; word < NEAR_WORD_COUNT; word++) {
+            uint64_t bits = m_near_bits[word];
+            if (word == _index / 64) { bits &= ~uint64_t(0) << (_index % 64); }
+            if (bits != 0) { return word * 64 + std::countr_zero(bits); }
+        }
+        return NEAR_SIZE;
+    }
+
+    void Cascade(unsigned _level, size_t _index) {
+        list_head timers;
+        INIT_LIST_HEAD(&timers);
+        list_splice_tail(&m_far[_level][_index], &timers);
+        INIT_LIST_HEAD(&m_far[_level][_index]);
+        while (!list_empty(&timers)) {
+            list_head* node = timers.next;
+            list_del(node);
+            Place(reinterpret_cast<timer_wheel_link_t*>(node)->item);
+        }
+    }
+
+    CppTimePoint m_start;
+    // the next tick to be walked
+    uint64_t m_current_tick;
+    size_t m_size;
+    list_head m_near[NEAR_SIZE];
+    uint64_t m_near_bits[NEAR_WORD_COUNT];
+    list_head m_far[FAR_LEVEL_COUNT][FAR_SIZE];
+    list_head m_expired;
+};
+}  // namespace nd
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,114 @@
+#include "wakeup_event.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+
+#include "log.hpp"
+#include "loop_clock.hpp"
+
+using namespace nd;
+using namespace std;
+
+#ifdef __linux__
+
+//-----------------------------------------------------------------------------
+
+WakeupEvent::WakeupEvent() : m_event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (m_event_fd < 0) {
+        LOG_FATAL("eventfd failed, errno:" << errno);
+        exit(-1);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+WakeupEvent::~WakeupEvent() { close(m_event_fd); }
+
+//-----------------------------------------------------------------------------
+
+void WakeupEvent::Signal() {
+    uint64_t count = 1;
+    // EAGAIN means the counter is saturated, which is still readable
+    while (write(m_event_fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+}
+
+//-----------------------------------------------------------------------------
+
+void WakeupEvent::WaitUntil(const CppTimePoint* _deadline) {
+    struct pollfd poll_fd = {m_event_fd, POLLIN, 0};
+    struct timespec timeout = {0, 0};
+    struct timespec* timeout_ptr = nullptr;
+    if (_deadline != nullptr) {
+        auto wait_ns = chrono::duration_cast<chrono::nanoseconds>(*_deadline - LoopClock::Now()).count();
+        if (wait_ns > 0) {
+            constexpr int64_t NANOSECONDS_PER_SECOND = 1000000000;
+            timeout.tv_sec = wait_ns / NANOSECONDS_PER_SECOND;
+            timeout.tv_nsec = wait_ns % NANOSECONDS_PER_SECOND;
+        }
+        timeout_ptr = &timeout;
+    }
+
+    if (ppoll(&poll_fd, 1, timeout_ptr, nullptr) > 0) { Clear(); }
+}
+
+//-----------------------------------------------------------------------------
+
+int WakeupEvent::Fd() const { return m_event_fd; }
+
+//-----------------------------------------------------------------------------
+
+void WakeupEvent::Clear() {
+    uint64_t count = 0;
+    while (read(m_event_fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+}
+
+#else
+
+//-----------------------------------------------------------------------------
+
+WakeupEvent::WakeupEvent() : m_is_signaled(false) {}
+
+//-----------------------------------------------------------------------------
+
+WakeupEvent::~WakeupEvent() {}
+
+//-----------------------------------------------------------------------------
+
+void WakeupEvent::Signal() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_is_signaled = true;
+    }
+    m_cond.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+
+void WakeupEvent::WaitUntil(const CppTimePoint* _deadline) {
+    unique_lock<mutex> lock(m_mutex);
+    if (_deadline != nullptr) {
+        m_cond.wait_until(lock, *_deadline, [this]() { return m_is_signaled; });
+    } else {
+        m_cond.wait(lock, [this]() { return m_is_signaled; });
+    }
+    m_is_signaled = false;
+}
+
+//-----------------------------------------------------------------------------
+
+int WakeupEvent::Fd() const { return -1; }
+
+//-----------------------------------------------------------------------------
+
+void WakeupEvent::Clear() {
+    lock_guard<mutex> lock(m_mutex);
+    m_is_signaled = false;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef WAKEUP_EVENT_H
+#define WAKEUP_EVENT_H
+
+#include <min_heap.h>
+
+#include <condition_variable>
+#include <mutex>
+
+namespace nd {
+
+//-----------------------------------------
+// Where a worker sleeps when it has nothing to do.
+// Linux uses an eventfd, so a signal that arrives before the wait is kept
+// and the wait returns at once, the deadline is honoured to the nanosecond by ppoll.
+// Elsewhere it falls back to a condition variable with the same semantics.
+// It is the parker's business to tell the producers whether a signal is needed at all.
+//-----------------------------------------
+class WakeupEvent {
+public:
+    WakeupEvent();
+    ~WakeupEvent();
+    WakeupEvent(const WakeupEvent&) = delete;
+    WakeupEvent& operator=(const WakeupEvent&) = delete;
+
+    // any thread
+    void Signal();
+
+    // the owner thread only, returns on a signal or when _deadline(if any) passes
+    void WaitUntil(const CppTimePoint* _deadline);
+
+    // pollable fd which turns readable on Signal(), -1 if the platform has none
+    int Fd() const;
+
+    // drops a pending signal without waiting
+    void Clear();
+
+private:
+#ifdef __linux__
+    int m_event_fd;
+#else
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_is_signaled;
+#endif
+};
+}  // namespace nd
+
+#endif /* WAKEUP_EVENT_H */
@@ -0,0 +1,196 @@
+#ifndef WHEN_ALL_H
+#define WHEN_ALL_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "task.hpp"
+
+namespace nd {
+
+//-----------------------------------------
+// co_await WhenAll(tasks) resumes the awaiting coroutine once all the tasks have returned,
+// co_await WhenAny(tasks) once the first one has, and gives its index.
+// A returning task counts down one atomic on its own worker instead of resuming the awaiter,
+// the one which brings it to zero resumes the awaiter, exactly once.
+// The tasks nobody started are started on the awaiting worker.
+// The results stay in the tasks, a co_await of a task afterwards gives its result(or throws) without suspending.
+// WhenAny detaches the losers, they run on by themselves and their results go with their last handle.
+//-----------------------------------------
+template <bool IS_ANY>
+class TaskSetAwaiter {
+public:
+    // what WhenAny of no task gives
+    static constexpr size_t NO_WINNER = std::numeric_limits<size_t>::max();
+
+    // room for _capacity tasks
+    explicit TaskSetAwaiter(size_t _capacity) : m_set(new TaskSet(_capacity)) {}
+    TaskSetAwaiter(TaskSetAwaiter&& _other) noexcept : m_set(std::exchange(_other.m_set, nullptr)) {}
+    TaskSetAwaiter(const TaskSetAwaiter&) = delete;
+    TaskSetAwaiter& operator=(const TaskSetAwaiter&) = delete;
+    ~TaskSetAwaiter() {
+        if (m_set != nullptr) { m_set->Release(); }
+    }
+
+    template <typename ReturnType>
+    void Add(const Task<ReturnType>& _task) {
+        assert(m_set->m_size < m_set->m_capacity);
+        TaskState* task = _task.m_promise;
+        task->AddRef();
+        Child& child = m_set->m_children[m_set->m_size];
+        child.m_on_return = &OnTaskReturn;
+        child.m_task = task;
+        child.m_set = m_set;
+        child.m_index = m_set->m_size++;
+    }
+
+    // NOLINTNEXTLINE
+    bool await_ready() const noexcept { return m_set->m_size == 0; }
+    // NOLINTNEXTLINE
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> _awaiting_coroutine) noexcept;
+    // NOLINTNEXTLINE
+    std::conditional_t<IS_ANY, size_t, void> await_resume();
+
+private:
+    struct TaskSet;
+
+    // the waiter put in each task
+    struct Child : TaskWaiter {
+        TaskState* m_task = nullptr;
+        TaskSet* m_set = nullptr;
+        size_t m_index = 0;
+    };
+
+    // shared by the awaiter and the waiters in the tasks, the losers of WhenAny may return after the awaiter is gone
+    struct TaskSet {
+        explicit TaskSet(size_t _capacity)
+            : m_ref_count(1),
+              m_count(0),
+              m_winner(NO_WINNER),
+              m_children(new Child[_capacity]),
+              m_capacity(_capacity),
+              m_size(0) {}
+        ~TaskSet() {
+            for (Child& child : Children()) { child.m_task->Release(); }
+        }
+
+        std::span<Child> Children() { return std::span<Child>(m_children.get(), m_size); }
+
+        void AddRef() { m_ref_count.fetch_add(1, std::memory_order_relaxed); }
+        void Release() {
+            if (m_ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) { delete this; }
+        }
+        // a task has returned, true if the awaiter goes on now
+        bool Arrive(size_t _index) {
+            if constexpr (IS_ANY) {
+                size_t no_winner = NO_WINNER;
+                if (!m_winner.compare_exchange_strong(no_winner, _index, std::memory_order_acq_rel)) { return false; }
+            }
+            return CountDown();
+        }
+        bool CountDown() { return m_count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+        std::atomic<uint32_t> m_ref_count;
+        // the returns to wait for(one for WhenAny), plus one held by await_suspend until every waiter is in
+        std::atomic<size_t> m_count;
+        std::atomic<size_t> m_winner;
+        TaskWaiter m_waiter;
+        // the waiters never move, they are linked into the tasks
+        std::unique_ptr<Child[]> m_children;
+        size_t m_capacity;
+        size_t m_size;
+    };
+
+    // on the returning worker
+    static TaskWaiter* OnTaskReturn(TaskWaiter* _waiter) {
+        auto* child = static_cast<Child*>(_waiter);
+        TaskSet* set = child->m_set;
+        TaskWaiter* resumed = set->Arrive(child->m_index) ? &set->m_waiter : nullptr;
+        if constexpr (IS_ANY) { set->Release(); }
+        return resumed;
+    }
+
+    TaskSet* m_set;
+};
+
+template <bool IS_ANY>
+std::coroutine_handle<> TaskSetAwaiter<IS_ANY>::await_suspend(std::coroutine_handle<> _awaiting_coroutine) noexcept {
+    TaskSet* set = m_set;
+    Worker* worker = Worker::GetCurrentWorker();
+    set->m_waiter.m_resume_node.m_handle = _awaiting_coroutine;
+    set->m_waiter.m_worker = worker;
+    set->m_count.store(IS_ANY ? 2 : set->m_size + 1, std::memory_order_relaxed);
+
+    for (Child& child : set->Children()) {
+        // the rest need no waiter once there is a winner
+        if (IS_ANY && set->m_winner.load(std::memory_order_relaxed) != NO_WINNER) { break; }
+
+        // a waiter of WhenAny holds the set, given back by the return or by the removal of the waiter,
+        // those of WhenAll all return before the awaiter goes on
+        if constexpr (IS_ANY) { set->AddRef(); }
+        if (!child.m_task->AddWaiter(&child)) {
+            set->Arrive(child.m_index);
+            if constexpr (IS_ANY) { set->Release(); }
+        }
+    }
+    for (Child& child : set->Children()) { child.m_task->Start(worker, JobPriority::Normal); }
+
+    // every task may have returned while the others were added
+    return set->CountDown() ? _awaiting_coroutine : std::noop_coroutine();
+}
+
+template <bool IS_ANY>
+std::conditional_t<IS_ANY, size_t, void> TaskSetAwaiter<IS_ANY>::await_resume() {
+    if constexpr (IS_ANY) {
+        size_t winner = m_set->m_winner.load(std::memory_order_acquire);
+        // the losers returning right now let go of the set by themselves
+        for (Child& child : m_set->Children()) {
+            if (child.m_index != winner && child.m_task->RemoveWaiter(&child)) { m_set->Release(); }
+        }
+        return winner;
+    }
+}
+
+// co_await WhenAll(task1, task2, ...), the tasks may have different result types
+template <typename... ReturnTypes>
+TaskSetAwaiter<false> WhenAll(const Task<ReturnTypes>&... _tasks) {
+    TaskSetAwaiter<false> awaiter(sizeof...(_tasks));
+    (awaiter.Add(_tasks), ...);
+    return awaiter;
+}
+
+// co_await WhenAll(tasks), of a range of tasks
+template <std::ranges::forward_range Range>
+TaskSetAwaiter<false> WhenAll(const Range& _tasks) {
+    TaskSetAwaiter<false> awaiter(static_cast<size_t>(std::ranges::distance(_tasks)));
+    for (const auto& task : _tasks) { awaiter.Add(task); }
+    return awaiter;
+}
+
+// size_t index = co_await WhenAny(task1, task2, ...)
+template <typename... ReturnTypes>
+TaskSetAwaiter<true> WhenAny(const Task<ReturnTypes>&... _tasks) {
+    TaskSetAwaiter<true> awaiter(sizeof...(_tasks));
+    (awaiter.Add(_tasks), ...);
+    return awaiter;
+}
+
+// size_t index = co_await WhenAny(tasks), of a range of tasks
+template <std::ranges::forward_range Range>
+TaskSetAwaiter<true> WhenAny(const Range& _tasks) {
+    TaskSetAwaiter<true> awaiter(static_cast<size_t>(std::ranges::distance(_tasks)));
+    for (const auto& task : _tasks) { awaiter.Add(task); }
+    return awaiter;
+}
+}  // namespace nd
+
+#endif /* WHEN_ALL_H */
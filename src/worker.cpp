@@ -1,9 +1,16 @@
 #include "worker.hpp"
 
 #include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <vector>
 
 #include "log.hpp"
 #include "min_heap.h"
+#include "worker_group.hpp"
 
 using namespace nd;
 using namespace std;
@@ -19,6 +26,26 @@ Worker::Worker()
     : m_worker_group_id(PreDefWorkerGroup::Invalid),
       m_worker_id(0),
       m_worker_num(0),
+      m_group(nullptr),
+      m_cpu(-1),
+      m_numa_node(-1),
+      m_batch_budget(DEFAULT_BATCH_BUDGET),
+      m_backlog_since_ns(0),
+      m_is_rehome_requested(false),
+      m_is_gated(false),
+      m_has_hand_overs(false),
+      m_queue_size(0),
+      m_lane_sizes{},
+      m_is_parked(false),
+      m_steal_credit(0),
+      m_queue_capacity(0),
+      m_submit_waiter_count(0),
+      m_submit_waiter_head(nullptr),
+      m_submit_waiter_tail(nullptr),
+      m_timer_backend(TimerBackend::Heap),
+      m_timer_slack_ms(0),
+      m_has_timer_requests(false),
+      m_step_depth(0),
       m_is_to_stop(false),
       m_is_wait_stop(false),
       m_is_stoped(false) {
@@ -28,8 +55,11 @@ Worker::Worker()
 //-----------------------------------------------------------------------------
 
 Worker::~Worker() {
+    // the requests never armed, their callers may still hold the handles
+    while (RemoteTimerNode* node = m_timer_mailbox.Pop()) { node->Release(); }
     assert(IsJobQueueEmpty());              // jobs should be empty for a elegant exit!
     assert(min_heap_empty(&m_timer_heap));  // timer heap shoude be empty for a elegant exit!
+    assert(m_timer_wheel.IsEmpty());
     min_heap_dtor(&m_timer_heap);
 }
 
@@ -37,87 +67,357 @@ Worker::~Worker() {
 
 void Worker::Stop() {
     m_is_to_stop = true;
-    m_queue_cond.notify_one();
+    m_wakeup_event.Signal();
 }
 
 //-----------------------------------------------------------------------------
 
 void Worker::WaitStop() {
     m_is_wait_stop = true;
-    m_queue_cond.notify_one();
+    m_wakeup_event.Signal();
 }
 
 //-----------------------------------------------------------------------------
 
 void Worker::WaitUntilEmpty() {
-    while (!IsJobQueueEmpty()) { InternalStep(); }
+    while (!IsJobQueueEmpty()) { InternalStep(false); }
 }
 
 //-----------------------------------------------------------------------------
 
-void Worker::AddJob(Job* _job) {
+void Worker::AddJob(Job* _job, JobPriority _priority) {
     if (m_is_to_stop || m_is_stoped) {
         delete _job;
         return;
     }
 
-    bool job_queue_empty = false;
-    {
-        lock_guard<mutex> lock(m_queue_mutex);
-        job_queue_empty = m_job_queue.empty();
-        m_job_queue.push_back(_job);
+    Enqueue(_job, _priority);
+}
+
+//-----------------------------------------------------------------------------
+
+bool Worker::TryAddJob(Job* _job, JobPriority _priority) {
+    if (m_is_to_stop || m_is_stoped) {
+        delete _job;
+        return true;
+    }
+    // the waiting coroutines go first
+    if (m_submit_waiter_count.load(std::memory_order_seq_cst) > 0) { return false; }
+
+    return TryEnqueue(_job, _priority);
+}
+
+//-----------------------------------------------------------------------------
+
+bool Worker::AddSubmitWaiter(SubmitAwaiter* _waiter) {
+    if (m_is_to_stop || m_is_stoped) {
+        delete _waiter->m_job;
+        _waiter->m_job = nullptr;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_submit_waiter_mutex);
+    bool is_first = m_submit_waiter_head == nullptr;
+    // pairs with InternalStep(): either we see the freed room, or it sees the waiter
+    m_submit_waiter_count.fetch_add(1, std::memory_order_seq_cst);
+    if (is_first && TryEnqueue(_waiter->m_job, _waiter->m_priority)) {
+        m_submit_waiter_count.fetch_sub(1, std::memory_order_seq_cst);
+        _waiter->m_job = nullptr;
+        return false;
+    }
+
+    if (m_submit_waiter_tail == nullptr) {
+        m_submit_waiter_head = _waiter;
+    } else {
+        m_submit_waiter_tail->m_next = _waiter;
+    }
+    m_submit_waiter_tail = _waiter;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::AdmitSubmitWaiters() {
+    std::lock_guard<std::mutex> lock(m_submit_waiter_mutex);
+    while (m_submit_waiter_head != nullptr) {
+        SubmitAwaiter* waiter = m_submit_waiter_head;
+        if (!TryEnqueue(waiter->m_job, waiter->m_priority)) { break; }
+
+        waiter->m_job = nullptr;
+        m_submit_waiter_head = waiter->m_next;
+        if (m_submit_waiter_head == nullptr) { m_submit_waiter_tail = nullptr; }
+        m_submit_waiter_count.fetch_sub(1, std::memory_order_seq_cst);
+        // the waiter lives in the coroutine frame, it may be gone once resumed
+        waiter->m_resume_worker->AddResume(&waiter->m_resume_node);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool Worker::AddStealableJobChain(Job* _first, Job* _last, size_t _count) {
+    if (m_is_to_stop || m_is_stoped) {
+        DeleteJobChain(_first, _count);
+        return true;
+    }
+
+    // pairs with Park() the same way Enqueue() does
+    size_t size = m_steal_queue.PushChain(_first, _last, _count);
+    bool is_parked = m_is_parked.load(std::memory_order_seq_cst);
+    WakeUp();
+    // a busy owner with a backlog is where an idle sibling helps
+    return is_parked || size <= 1;
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::AddJobs(std::span<const SessionJob> _jobs, JobPriority _priority) {
+    if (_jobs.empty()) { return; }
+
+    for (size_t i = 1; i < _jobs.size(); i++) { LinkJob(_jobs[i - 1].m_job, _jobs[i].m_job); }
+    AddJobChain(_jobs.front().m_job, _jobs.back().m_job, _jobs.size(), _priority);
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::AddJobChain(Job* _first, Job* _last, size_t _count, JobPriority _priority) {
+    if (m_is_to_stop || m_is_stoped) {
+        DeleteJobChain(_first, _count);
+        return;
+    }
+
+    EnqueueChain(_first, _last, _count, _priority);
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::DeleteJobChain(Job* _first, size_t _count) {
+    for (size_t i = 0; i < _count; i++) {
+        Job* next = static_cast<Job*>(static_cast<JobNode*>(_first->m_next.load(std::memory_order_relaxed)));
+        delete _first;
+        _first = next;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::AddResume(CoroutineNode* _node, JobPriority _priority) {
+    // the coroutine stays suspended, as a dropped resume job did
+    if (m_is_to_stop || m_is_stoped) { return; }
+
+    Enqueue(_node, _priority);
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::EnqueueChain(JobNode* _first, JobNode* _last, size_t _count, JobPriority _priority) {
+    size_t lane = static_cast<size_t>(_priority);
+    // pairs with Park(): either the worker sees the new size, or we see it parked
+    m_queue_size.fetch_add(_count, std::memory_order_seq_cst);
+    m_lane_sizes[lane].fetch_add(_count, std::memory_order_relaxed);
+    m_job_queues[lane].PushChain(_first, _last);
+    WakeUp();
+}
+
+//-----------------------------------------------------------------------------
+
+bool Worker::TryEnqueue(JobNode* _node, JobPriority _priority) {
+    if (m_queue_capacity == 0) {
+        Enqueue(_node, _priority);
+        return true;
+    }
+
+    // reserve a slot first, so that racing producers can't overshoot the capacity
+    if (m_queue_size.fetch_add(1, std::memory_order_seq_cst) >= m_queue_capacity) {
+        m_queue_size.fetch_sub(1, std::memory_order_seq_cst);
+        return false;
     }
-    if (job_queue_empty) { m_queue_cond.notify_one(); }
+    size_t lane = static_cast<size_t>(_priority);
+    m_lane_sizes[lane].fetch_add(1, std::memory_order_relaxed);
+    m_job_queues[lane].Push(_node);
+    WakeUp();
+    return true;
 }
 
 //-----------------------------------------------------------------------------
 
-TimerHandle Worker::AddLocalTimer(uint64_t _ms_time, TimerCallback _callback) {
-    if (m_is_to_stop || m_is_wait_stop) { return NULL; }
+TimerHandle Worker::AddLocalTimer(uint64_t _ms_time, TimerCallback _callback, uint64_t _slack_ms) {
+    return AddLocalTimerAt(GetLoopTime() + std::chrono::milliseconds(_ms_time), std::move(_callback), _slack_ms);
+}
+
+//-----------------------------------------------------------------------------
+
+TimerHandle Worker::AddLocalTimerAt(CppTimePoint _deadline, TimerCallback _callback, uint64_t _slack_ms) {
+    if (m_is_to_stop || m_is_wait_stop) { return nullptr; }
 
-    bool timer_heap_empty = min_heap_empty(&m_timer_heap) != 0;
     constexpr size_t MIN_HEAP_RESERVE_SIZE = 128;
-    if (MIN_HEAP_RESERVE_SIZE > min_heap_size(&m_timer_heap)) {
+    if (m_timer_backend == TimerBackend::Heap && MIN_HEAP_RESERVE_SIZE > min_heap_size(&m_timer_heap)) {
         min_heap_reserve(&m_timer_heap, MIN_HEAP_RESERVE_SIZE);
     }
 
-    TimerHandle timeout_evt = new min_heap_item_t();
-    timeout_evt->callback = _callback;
-    timeout_evt->timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(_ms_time);
+    min_heap_item_t* timeout_evt = m_timer_pool.Allocate();
+    timeout_evt->callback = std::move(_callback);
+    timeout_evt->timeout = ApplyTimerSlack(_deadline, _slack_ms == DEFAULT_TIMER_SLACK ? m_timer_slack_ms : _slack_ms);
 
+    if (m_timer_backend == TimerBackend::Wheel) {
+        m_timer_wheel.Add(timeout_evt);
+        WakeUp();
+        return TimerHandle(timeout_evt, &m_timer_pool);
+    }
     if (-1 == min_heap_push(&m_timer_heap, timeout_evt)) {
         LOG_FATAL("not enough memory!");
         exit(-1);
     }
-    if (timer_heap_empty) { m_queue_cond.notify_one(); }
-    return timeout_evt;
+    // a parked worker has to sleep for less from now on
+    if (min_heap_elt_is_top(timeout_evt)) { WakeUp(); }
+    return TimerHandle(timeout_evt, &m_timer_pool);
 }
 
 //-----------------------------------------------------------------------------
 
 void Worker::CancelLocalTimer(TimerHandle& _event) {
-    if (_event == NULL) { return; }
-    min_heap_erase(&m_timer_heap, _event);
-    delete _event;
-    _event = NULL;
+    // the entry is in the heap(or wheel) of the worker which added it
+    assert(!_event || _event.IsOf(&m_timer_pool));
+    // a timer which fired or was cancelled already may have handed its slot on
+    min_heap_item_t* entry = _event.Get();
+    _event = nullptr;
+    if (entry == nullptr) { return; }
+
+    if (m_timer_backend == TimerBackend::Wheel) {
+        m_timer_wheel.Remove(entry);
+    } else {
+        min_heap_erase(&m_timer_heap, entry);
+    }
+    m_timer_pool.Free(entry);
+}
+
+//-----------------------------------------------------------------------------
+
+RemoteTimer Worker::AddRemoteTimer(uint64_t _ms_time, TimerCallback _callback, uint64_t _slack_ms) {
+    if (m_is_to_stop || m_is_wait_stop) { return RemoteTimer(); }
+
+    // the deadline counts from the caller's now, not from when the worker gets to it
+    auto node = new RemoteTimerNode(
+        this, LoopClock::Now() + std::chrono::milliseconds(_ms_time), _slack_ms, std::move(_callback));
+    PostTimerRequest(node);
+    return RemoteTimer(node);
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::PostTimerRequest(RemoteTimerNode* _node) {
+    m_timer_mailbox.Push(_node);
+    // pairs with Park(): either the worker sees the flag, or we see it parked
+    m_has_timer_requests.store(true, std::memory_order_seq_cst);
+    WakeUp();
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::DrainTimerMailbox() {
+    // a push still in flight sets the flag again once it is done
+    m_has_timer_requests.store(false, std::memory_order_seq_cst);
+    while (RemoteTimerNode* node = m_timer_mailbox.Pop()) {
+        uint32_t state = node->m_state.load(std::memory_order_acquire);
+        if ((state & RemoteTimerNode::ARMED) != 0) {
+            // cancelled after it was armed, a fired timer leaves a stale handle behind
+            CancelLocalTimer(node->m_timer);
+            node->Release();
+            continue;
+        }
+        if ((state & RemoteTimerNode::CANCELLED) != 0) {
+            node->Release();
+            continue;
+        }
+
+        node->m_timer = AddLocalTimerAt(node->m_deadline, [node]() { FireRemoteTimer(node); }, node->m_slack_ms);
+        if (!node->m_timer) {
+            // the worker is stopping, the timer will never fire
+            node->m_state.fetch_or(RemoteTimerNode::CANCELLED, std::memory_order_acq_rel);
+            node->Release();
+            continue;
+        }
+        state = node->m_state.fetch_or(RemoteTimerNode::ARMED, std::memory_order_acq_rel);
+        if ((state & RemoteTimerNode::CANCELLED) != 0) {
+            // the canceller found it unarmed and left it to us
+            CancelLocalTimer(node->m_timer);
+            node->Release();
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::FireRemoteTimer(RemoteTimerNode* _node) {
+    uint32_t state = _node->m_state.fetch_or(RemoteTimerNode::FIRED, std::memory_order_acq_rel);
+    // a cancelled one comes back through the mailbox, which drops it then
+    if ((state & RemoteTimerNode::CANCELLED) != 0) { return; }
+    _node->m_callback();
+    _node->Release();
+}
+
+//-----------------------------------------------------------------------------
+
+CppTimePoint Worker::ApplyTimerSlack(CppTimePoint _deadline, uint64_t _slack_ms) {
+    if (_slack_ms == 0) { return _deadline; }
+
+    // on the clock's own ms grid, so that the workers line up with each other as well
+    using Milliseconds = std::chrono::milliseconds;
+    auto earliest = std::chrono::ceil<Milliseconds>(_deadline.time_since_epoch()).count();
+    if (earliest <= 0) { return _deadline; }
+    uint64_t first = static_cast<uint64_t>(earliest);
+    uint64_t limit = first + _slack_ms;
+    // keep the highest bit where the two ends differ, clear all the bits below it
+    uint64_t mask = (uint64_t(1) << (std::bit_width(first ^ limit) - 1)) - 1;
+    return CppTimePoint(std::chrono::duration_cast<CppTimePoint::duration>(Milliseconds(limit & ~mask)));
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::FireTimer(min_heap_item_t* _entry) {
+    // the slot is free before the callback runs, so that cancelling its own handle does nothing
+    TimerCallback callback = std::move(_entry->callback);
+    m_timer_pool.Free(_entry);
+    callback();
 }
 
 //-----------------------------------------------------------------------------
 
 void Worker::HandleLocalTimer() {
+    m_loop_time = LoopClock::Now();
+    m_step_depth++;
+    ExpireTimers();
+    m_step_depth--;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t Worker::ExpireTimers() {
+    if (m_has_timer_requests.load(std::memory_order_relaxed)) { DrainTimerMailbox(); }
+    size_t fired_count = 0;
+    if (m_timer_backend == TimerBackend::Wheel) {
+        if (m_timer_wheel.IsEmpty()) { return 0; }
+        // the whole due slots at once, a callback may still cancel a timer taken along
+        m_timer_wheel.Expire(m_loop_time);
+        while (min_heap_item_t* timer = m_timer_wheel.PopExpired()) {
+            FireTimer(timer);
+            fired_count++;
+        }
+        return fired_count;
+    }
+
     if (min_heap_empty(&m_timer_heap) == 0) {
-        auto time_now = std::chrono::steady_clock::now();
         while (min_heap_empty(&m_timer_heap) == 0) {
-            TimerHandle top_event = min_heap_top(&m_timer_heap);
-            if (item_cmp(top_event->timeout, time_now, <=)) {
+            min_heap_item_t* top_event = min_heap_top(&m_timer_heap);
+            if (item_cmp(top_event->timeout, m_loop_time, <=)) {
                 min_heap_pop(&m_timer_heap);
-                (top_event->callback)();
-                delete top_event;
+                FireTimer(top_event);
+                fired_count++;
             } else {
                 break;
             }
         }
     }
+    return fired_count;
 }
 
 //-----------------------------------------------------------------------------
@@ -127,15 +427,19 @@ void Worker::ThreadMain() {
     s_current_thread_id = std::this_thread::get_id();
     s_current_worker_group_id = m_worker_group_id;
     s_current_worker_id = m_worker_id;
+    // a pinned worker tells where it runs
+    char placement[24] = "";
+    if (m_cpu >= 0) { snprintf(placement, sizeof(placement), " cpu%d/n%d", m_cpu, m_numa_node); }
     if (m_worker_num > 1) {
         snprintf(s_worker_name,
                  MAX_WORKER_NAME_LEN - 1,
-                 "[%s %d/%d]",
+                 "[%s %d/%d%s]",
                  m_worker_group_name.c_str(),
                  m_worker_id,
-                 m_worker_num);
+                 m_worker_num,
+                 placement);
     } else {
-        snprintf(s_worker_name, MAX_WORKER_NAME_LEN - 1, "[%s]", m_worker_group_name.c_str());
+        snprintf(s_worker_name, MAX_WORKER_NAME_LEN - 1, "[%s%s]", m_worker_group_name.c_str(), placement);
     }
     LOG_TRACE("worker start");
 
@@ -145,38 +449,215 @@ void Worker::ThreadMain() {
 
 //-----------------------------------------------------------------------------
 
-void Worker::InternalStep() {
-    Job* job = NULL;
-    {
-        lock_guard<mutex> lock(m_queue_mutex);
-        if (!m_job_queue.empty()) {
-            job = m_job_queue.front();
-            m_job_queue.pop_front();
-        } else if (m_is_wait_stop) {
-            return;
+size_t Worker::InternalStep(bool _can_park) {
+    m_loop_time = LoopClock::Now();
+    m_step_depth++;
+    size_t job_count = RunStep(_can_park);
+    m_step_depth--;
+    return job_count;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t Worker::RunStep(bool _can_park) {
+    if (m_is_rehome_requested.load(std::memory_order_relaxed) && m_is_rehome_requested.exchange(false)) {
+        Rehome();
+    }
+    if (IsGated()) {
+        // the timers do not wait for the gate
+        if (m_has_timer_requests.load(std::memory_order_relaxed)) { DrainTimerMailbox(); }
+        if (_can_park) { Park(); }
+        return 0;
+    }
+    if (m_has_hand_overs.load(std::memory_order_acquire)) { TakeHandOvers(); }
+
+    // drain mode: run up to the batch budget back to back,
+    // the queue size and the timers are only touched once per batch
+    UpdateBacklog();
+    size_t budget = m_batch_budget.load(std::memory_order_relaxed);
+    // the session-less jobs keep their share of every batch, or full lanes would starve them,
+    // siblings only steal once idle
+    size_t steal_reserve = 0;
+    if (m_steal_queue.Size() > 0) {
+        m_steal_credit += budget * STEAL_QUEUE_WEIGHT;
+        steal_reserve = std::min<size_t>(m_steal_credit / BATCH_WEIGHT_TOTAL, budget);
+        m_steal_credit -= steal_reserve * BATCH_WEIGHT_TOTAL;
+    } else {
+        m_steal_credit = 0;
+    }
+    size_t job_count = DrainLanes(budget - steal_reserve);
+    size_t session_job_count = job_count;
+    // then the reserve and whatever the lanes left of the budget, all taken under one lock
+    JobChain stealable_jobs = m_steal_queue.PopUpTo(budget - job_count);
+    while (JobNode* job = stealable_jobs.PopFront()) {
+        RunJob(job);
+        job_count++;
+    }
+    if (session_job_count > 0) {
+        m_queue_size.fetch_sub(session_job_count, std::memory_order_seq_cst);
+        if (m_submit_waiter_count.load(std::memory_order_seq_cst) > 0) { AdmitSubmitWaiters(); }
+    } else if (job_count == 0 && m_is_wait_stop && IsJobQueueEmpty()) {
+        return 0;
+    }
+
+    // handle timer, after a batch the clock has moved on
+    if (job_count > 0) { m_loop_time = LoopClock::Now(); }
+    size_t fired_count = ExpireTimers();
+
+    // only an idle step sleeps, so that a Step() caller gets to see what the batch(or a timer) did,
+    // a timer may have resumed a whole chain of coroutines in place without queueing anything
+    if (job_count > 0 || fired_count > 0 || !_can_park || !IsJobQueueEmpty()) { return job_count; }
+    if (StealFromSiblings()) { return 0; }
+    Park();
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t Worker::DrainLanes(size_t _budget) {
+    size_t job_count = 0;
+    bool is_lane_left = true;
+    while (is_lane_left && job_count < _budget) {
+        is_lane_left = false;
+        for (size_t lane = 0; lane < JOB_PRIORITY_COUNT && job_count < _budget; lane++) {
+            size_t quota = std::min<size_t>(JOB_LANE_WEIGHTS[lane], _budget - job_count);
+            size_t lane_job_count = 0;
+            while (lane_job_count < quota) {
+                JobNode* job = PopLane(lane);
+                if (job == NULL) { break; }
+
+                RunJob(job);
+                lane_job_count++;
+            }
+            if (lane_job_count == 0) { continue; }
+
+            m_lane_sizes[lane].fetch_sub(lane_job_count, std::memory_order_relaxed);
+            job_count += lane_job_count;
+            is_lane_left = is_lane_left || lane_job_count == quota;
         }
     }
+    return job_count;
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::UpdateBacklog() {
+    // only the transitions write, a worker that keeps up never leaves 0
+    bool is_empty = IsJobQueueEmpty();
+    bool was_backlogged = m_backlog_since_ns.load(std::memory_order_relaxed) != 0;
+    if (is_empty == !was_backlogged) { return; }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(m_loop_time.time_since_epoch()).count();
+    m_backlog_since_ns.store(is_empty ? 0 : std::max<int64_t>(now, 1), std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+
+int64_t Worker::GetBacklogAgeMs() const {
+    int64_t since = m_backlog_since_ns.load(std::memory_order_relaxed);
+    if (since == 0) { return 0; }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(LoopClock::Now().time_since_epoch()).count();
+    return (now - since) / 1000000;
+}
+
+//-----------------------------------------------------------------------------
 
-    // handle Job
-    if (job != NULL) {
-        (*job)();
-        delete job;
+void Worker::Rehome() {
+    // what an earlier resize handed over and is still waiting here may have to move on as well
+    if (m_has_hand_overs.load(std::memory_order_acquire)) { TakeHandOvers(); }
+    std::vector<JobChain> moved(m_group->m_workers.size());
+    for (size_t lane = 0; lane < JOB_PRIORITY_COUNT; lane++) {
+        // a node still being pushed ends the walk, it was queued after all the others anyway
+        JobChain kept;
+        size_t moved_count = 0;
+        while (JobNode* node = PopLane(lane)) {
+            Worker* target = this;
+            if (node->m_kind == JobKind::Callable) {
+                SessionId session_id = static_cast<Job*>(node)->m_session_id;
+                if (session_id != ANY_SESSION) { target = m_group->GetWorker(session_id); }
+            }
+            if (target == this) {
+                kept.Append(node);
+                continue;
+            }
+            moved[target->m_worker_id].Append(node);
+            moved_count++;
+        }
+        m_front_lanes[lane] = kept;
+        if (moved_count == 0) { continue; }
+
+        m_lane_sizes[lane].fetch_sub(moved_count, std::memory_order_relaxed);
+        m_queue_size.fetch_sub(moved_count, std::memory_order_seq_cst);
+        for (size_t i = 0; i < moved.size(); i++) {
+            if (moved[i].IsEmpty()) { continue; }
+            m_group->m_workers[i]->HandOver(lane, moved[i]);
+            moved[i] = JobChain();
+        }
     }
+    m_group->OnWorkerRehomed();
+}
+
+//-----------------------------------------------------------------------------
 
-    // handle timer
-    HandleLocalTimer();
+void Worker::HandOver(size_t _lane, JobChain& _chain) {
+    // only a worker the router said may gain sessions is gated, and gets any
+    assert(IsGated());
+    std::lock_guard<std::mutex> lock(m_hand_over_mutex);
+    size_t count = _chain.m_count;
+    while (JobNode* node = _chain.PopFront()) { m_hand_over_lanes[_lane].Append(node); }
+    m_lane_sizes[_lane].fetch_add(count, std::memory_order_relaxed);
+    m_queue_size.fetch_add(count, std::memory_order_seq_cst);
+    m_has_hand_overs.store(true, std::memory_order_release);
+}
 
-    unique_lock<mutex> queue_lock(m_queue_mutex);
-    if (!m_job_queue.empty()) { return; }
+//-----------------------------------------------------------------------------
 
-    constexpr size_t MAX_WAIT_TIME_WITH_TIMER_MICROSECONDS =
-        500;  // it is the balance of the timer accuracy and the cpu usage
-    constexpr size_t MAX_WAIT_TIME_MICROSECONDS = 10000;
-    if (!m_is_to_stop && !m_is_wait_stop && m_job_queue.empty() && (min_heap_empty(&m_timer_heap) == 0)) {
-        m_queue_cond.wait_for(queue_lock, chrono::microseconds(MAX_WAIT_TIME_WITH_TIMER_MICROSECONDS));
-    } else {
-        m_queue_cond.wait_for(queue_lock, chrono::microseconds(MAX_WAIT_TIME_MICROSECONDS));
+void Worker::TakeHandOvers() {
+    std::lock_guard<std::mutex> lock(m_hand_over_mutex);
+    for (size_t lane = 0; lane < JOB_PRIORITY_COUNT; lane++) {
+        while (JobNode* node = m_hand_over_lanes[lane].PopFront()) { m_front_lanes[lane].Append(node); }
+    }
+    m_has_hand_overs.store(false, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+
+bool Worker::StealFromSiblings() {
+    if (m_group == NULL || m_is_to_stop || m_is_wait_stop) { return false; }
+    return m_group->Steal(this) > 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::Park() {
+    if (m_is_to_stop || m_is_wait_stop) { return; }
+
+    // pairs with Enqueue(): either a producer sees us parked, or we see its job,
+    // a gated worker sleeps on its jobs until the gate is lifted
+    m_is_parked.store(true, std::memory_order_seq_cst);
+    if (!IsIdle()) {
+        m_is_parked.store(false, std::memory_order_relaxed);
+        return;
+    }
+
+    // sleep exactly until the first timer is due, or for good without timers
+    CppTimePoint deadline;
+    m_wakeup_event.WaitUntil(GetNextDeadline(deadline) ? &deadline : NULL);
+    m_is_parked.store(false, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+
+void Worker::RunJob(JobNode* _node) {
+    if (_node->m_kind == JobKind::Coroutine) {
+        static_cast<CoroutineNode*>(_node)->m_handle.resume();
+        return;
     }
+
+    Job* job = static_cast<Job*>(_node);
+    (*job)();
+    delete job;
 }
 
 //-----------------------------------------------------------------------------
@@ -185,3 +666,44 @@ void Worker::Step() {
     assert(std::this_thread::get_id() == s_current_thread_id);
     InternalStep();
 }
+
+//-----------------------------------------------------------------------------
+
+bool Worker::GetNextDeadline(CppTimePoint& _deadline) {
+    if (m_timer_backend == TimerBackend::Wheel) { return m_timer_wheel.GetNextDeadline(_deadline); }
+    if (min_heap_empty(&m_timer_heap) != 0) { return false; }
+    _deadline = min_heap_top(&m_timer_heap)->timeout;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+int Worker::PrepareWait() {
+    assert(std::this_thread::get_id() == s_current_thread_id);
+    // the same handshake as Park(), the host loop sleeps in our place
+    m_is_parked.store(true, std::memory_order_seq_cst);
+    if (!IsIdle()) {
+        m_is_parked.store(false, std::memory_order_relaxed);
+        return 0;
+    }
+
+    CppTimePoint deadline;
+    if (!GetNextDeadline(deadline)) { return -1; }
+    // rounded up, a host waking up before the deadline would only spin
+    auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(deadline - LoopClock::Now());
+    if (wait_us.count() <= 0) {
+        m_is_parked.store(false, std::memory_order_relaxed);
+        return 0;
+    }
+    constexpr int64_t MAX_WAIT_MS = INT32_MAX;
+    return static_cast<int>(std::min<int64_t>((wait_us.count() + 999) / 1000, MAX_WAIT_MS));
+}
+
+//-----------------------------------------------------------------------------
+
+size_t Worker::RunReadyJobs() {
+    assert(std::this_thread::get_id() == s_current_thread_id);
+    m_is_parked.store(false, std::memory_order_seq_cst);
+    m_wakeup_event.Clear();
+    return InternalStep(false);
+}
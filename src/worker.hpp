@@ -5,23 +5,43 @@
 
 #include <atomic>
 #include <cassert>
-#include <condition_variable>
 #include <functional>
 #include <list>
+#include <loop_clock.hpp>
+#include <mutex>
+#include <remote_timer.hpp>
 #include <singleton.hpp>
+#include <span>
+#include <steal_queue.hpp>
 #include <thread>
+#include <timer_pool.hpp>
+#include <timer_wheel.hpp>
+#include <wakeup_event.hpp>
 #include <worker_types.hpp>
 
 namespace nd {
 
-constexpr size_t MAX_WORKER_NAME_LEN = 32;
+constexpr size_t MAX_WORKER_NAME_LEN = 48;
+
+class WorkerGroup;
+class SubmitAwaiter;
 
 class Worker {
 public:
+    friend class WorkerGroup;
+    friend class SubmitAwaiter;
+    friend class RemoteTimer;
+
     Worker();
     ~Worker();
 
-    void Init(int _worker_group_id, int _worker_id, int _thread_num, std::string& _group_name) {
+    void Init(int _worker_group_id,
+              int _worker_id,
+              int _thread_num,
+              std::string& _group_name,
+              const WorkerGroupOptions& _options = {},
+              WorkerGroup* _group = nullptr,
+              int _cpu = -1) {
         // init once only
         assert(m_worker_group_id == PreDefWorkerGroup::Invalid);
 
@@ -29,15 +49,36 @@ public:
         m_worker_id = _worker_id;
         m_worker_num = _thread_num;
         m_worker_group_name = _group_name;
+        m_group = _group;
+        m_cpu = _cpu;
+        m_numa_node = NumaNodeOfCpu(_cpu);
+        m_queue_capacity = _options.m_queue_capacity;
+        // before any timer is added
+        assert(IsTimerEmpty());
+        m_timer_backend = _options.m_timer_backend;
+        m_timer_slack_ms = _options.m_timer_slack_ms;
+        SetBatchBudget(_options.m_batch_budget);
     }
 
-    bool IsJobQueueEmpty() {
-        std::lock_guard<std::mutex> lock(m_queue_mutex);
-        return m_job_queue.empty();
+    // can be changed from any thread, it takes effect from the next batch
+    void SetBatchBudget(unsigned _batch_budget) {
+        m_batch_budget.store(_batch_budget > 0 ? _batch_budget : 1, std::memory_order_relaxed);
     }
-    size_t GetQueueSize() {
-        std::lock_guard<std::mutex> lock(m_queue_mutex);
-        return m_job_queue.size();
+    unsigned GetBatchBudget() const { return m_batch_budget.load(std::memory_order_relaxed); }
+
+    // a job is counted before it is linked into the queue,
+    // so a non-empty result may briefly precede the job being poppable
+    bool IsJobQueueEmpty() const { return m_queue_size.load() == 0 && m_steal_queue.Size() == 0; }
+    size_t GetQueueSize() const { return m_queue_size.load() + m_steal_queue.Size(); }
+    size_t GetQueueCapacity() const { return m_queue_capacity; }
+    // -1 for an unpinned worker
+    int GetCpu() const { return m_cpu; }
+    int GetNumaNode() const { return m_numa_node; }
+    // how long the worker has not caught up with its queue, 0 if it was empty at its last batch
+    int64_t GetBacklogAgeMs() const;
+    // jobs queued in one lane, a snapshot for monitoring
+    size_t GetLaneSize(JobPriority _priority) const {
+        return m_lane_sizes[static_cast<size_t>(_priority)].load(std::memory_order_relaxed);
     }
 
     static void MarkMainThread() {
@@ -56,6 +97,9 @@ public:
         // had to run step() in main to run all the jobs in the queue
         return Singleton<Worker, 0>::Instance();
     }
+    // links the job behind _prev, for building chains
+    static void LinkJob(Job* _prev, Job* _job) { _prev->m_next.store(_job, std::memory_order_relaxed); }
+
     static Worker* GetCurrentWorker() {
         assert(s_current_worker != nullptr);
         return s_current_worker;
@@ -69,18 +113,120 @@ public:
     void WaitStop();
     void WaitUntilEmpty();
 
-    void AddJob(Job* _job);
-    TimerHandle AddLocalTimer(uint64_t _ms_time, TimerCallback _callback);
+    void AddJob(Job* _job, JobPriority _priority = JobPriority::Normal);
+    // all the jobs go in one queue operation with at most one wakeup, the session ids are ignored
+    void AddJobs(std::span<const SessionJob> _jobs, JobPriority _priority = JobPriority::Normal);
+    // [_first, _last] must be linked through m_next already
+    void AddJobChain(Job* _first, Job* _last, size_t _count, JobPriority _priority = JobPriority::Normal);
+    // returns false if the queue is at capacity, the job then stays with the caller
+    bool TryAddJob(Job* _job, JobPriority _priority = JobPriority::Normal);
+    // co_await it to queue _job, the coroutine is suspended while the queue is at capacity
+    SubmitAwaiter AwaitAddJob(Job* _job, JobPriority _priority = JobPriority::Normal);
+    template <JobCallable Func>
+    SubmitAwaiter AwaitAddJob(Func&& _func, JobPriority _priority = JobPriority::Normal);
+    // a job any worker of the group may run, returns false if it leaves a backlog for a sibling
+    bool AddStealableJob(Job* _job) { return AddStealableJobChain(_job, _job, 1); }
+    bool AddStealableJobChain(Job* _first, Job* _last, size_t _count);
+    // the node must stay valid until the coroutine is resumed
+    void AddResume(CoroutineNode* _node, JobPriority _priority = JobPriority::High);
+    // for a coroutine that carries no node
+    void AddResume(std::coroutine_handle<> _handle, JobPriority _priority = JobPriority::High) {
+        AddJob([_handle]() { _handle.resume(); }, _priority);
+    }
+    // wraps the callable in a pooled job, no need to new one
+    template <JobCallable Func>
+    void AddJob(Func&& _func, JobPriority _priority = JobPriority::Normal) {
+        AddJob(new Job(std::forward<Func>(_func)), _priority);
+    }
+    // the timer fires somewhere in [_ms_time, _ms_time + _slack_ms] from now,
+    // on a boundary shared with the other timers of that window
+    TimerHandle AddLocalTimer(uint64_t _ms_time, TimerCallback _callback, uint64_t _slack_ms = DEFAULT_TIMER_SLACK);
+    // the same with an absolute LoopClock deadline
+    TimerHandle AddLocalTimerAt(CppTimePoint _deadline,
+                                TimerCallback _callback,
+                                uint64_t _slack_ms = DEFAULT_TIMER_SLACK);
     void CancelLocalTimer(TimerHandle& _event);
+    // the thread-safe counterpart of AddLocalTimer(), for any thread,
+    // the request goes through a lock-free mailbox and the callback runs on this worker
+    RemoteTimer AddRemoteTimer(uint64_t _ms_time, TimerCallback _callback, uint64_t _slack_ms = DEFAULT_TIMER_SLACK);
 
     // thread runable function
     void ThreadMain();
 
     void Step();
+    // fires the due timers against a fresh clock reading
     void HandleLocalTimer();
+    // the clock as of the start of the running batch(refreshed before its timers), LoopClock::Now() outside a step,
+    // the relative timers count from here, so a job scheduling many of them reads the clock once
+    CppTimePoint GetLoopTime() const { return m_step_depth > 0 ? m_loop_time : LoopClock::Now(); }
+
+    // for a host event loop driving the worker instead of Step(), on the worker's thread:
+    //   int timeout_ms = worker->PrepareWait();
+    //   epoll_wait(..., timeout_ms);  // with GetEventFd() registered for reading
+    //   worker->RunReadyJobs();
+    // the fd turns readable once a job comes after PrepareWait(), -1 if the platform has none
+    int GetEventFd() const { return m_wakeup_event.Fd(); }
+    bool IsTimerEmpty() { return min_heap_empty(&m_timer_heap) != 0 && m_timer_wheel.IsEmpty(); }
+    // the earliest timer, false if there is none
+    bool GetNextDeadline(CppTimePoint& _deadline);
+    // arms the fd, returns how long the host may sleep in ms: 0 if there is work already, -1 for no limit
+    int PrepareWait();
+    // runs a batch and the due timers without ever blocking, returns how many jobs ran
+    size_t RunReadyJobs();
 
 private:
-    void InternalStep();
+    void Enqueue(JobNode* _node, JobPriority _priority) { EnqueueChain(_node, _node, 1, _priority); }
+    void EnqueueChain(JobNode* _first, JobNode* _last, size_t _count, JobPriority _priority);
+    static void DeleteJobChain(Job* _first, size_t _count);
+    bool TryEnqueue(JobNode* _node, JobPriority _priority);
+    // weighted round robin over the lanes, returns how many jobs ran
+    size_t DrainLanes(size_t _budget);
+    // the nodes kept by Rehome() go before the ones still in the queue
+    JobNode* PopLane(size_t _lane) {
+        if (!m_front_lanes[_lane].IsEmpty()) { return m_front_lanes[_lane].PopFront(); }
+        return m_job_queues[_lane].Pop();
+    }
+    // on the worker thread once a resize changed the routing:
+    // hands the queued jobs whose session is routed to another worker now over to it, in their order
+    void Rehome();
+    // the target side, the jobs wait there until the group lifts the gate
+    void HandOver(size_t _lane, JobChain& _chain);
+    // the handed over jobs go before anything queued since the resize
+    void TakeHandOvers();
+    bool IsGated() const { return m_is_gated.load(std::memory_order_seq_cst); }
+    void UpdateBacklog();
+    // returns false if the job was queued at once instead
+    bool AddSubmitWaiter(SubmitAwaiter* _waiter);
+    // hands the freed room to the waiting coroutines in their order
+    void AdmitSubmitWaiters();
+    // wakes the worker up if, and only if, it is parked
+    void WakeUp() {
+        if (m_is_parked.load(std::memory_order_seq_cst) && m_is_parked.exchange(false, std::memory_order_seq_cst)) {
+            m_wakeup_event.Signal();
+        }
+    }
+    void Park();
+    bool StealFromSiblings();
+    static void RunJob(JobNode* _node);
+    void FireTimer(min_heap_item_t* _entry);
+    // any thread
+    void PostTimerRequest(RemoteTimerNode* _node);
+    // arms the timers requested from other threads and takes out the cancelled ones
+    void DrainTimerMailbox();
+    static void FireRemoteTimer(RemoteTimerNode* _node);
+    // the latest deadline in the window with the most trailing zero bits(in ms), like the kernel's timer slack
+    static CppTimePoint ApplyTimerSlack(CppTimePoint _deadline, uint64_t _slack_ms);
+    // returns how many fired
+    size_t ExpireTimers();
+    // runs a batch and the due timers, then sleeps if there is nothing left and _can_park,
+    // returns how many jobs ran
+    size_t InternalStep(bool _can_park = true);
+    size_t RunStep(bool _can_park);
+    // nothing to run before the next signal or timer
+    bool IsIdle() const {
+        return (IsJobQueueEmpty() || IsGated()) && !m_is_rehome_requested && !m_has_timer_requests &&
+               !m_is_to_stop && !m_is_wait_stop;
+    }
     thread_local static Worker* s_current_worker;
     thread_local static std::thread::id s_current_thread_id;
     thread_local static int s_current_worker_group_id;
@@ -91,19 +237,112 @@ private:
     int m_worker_id;
     int m_worker_num;
     std::string m_worker_group_name;
+    WorkerGroup* m_group;
+    int m_cpu;
+    int m_numa_node;
+    std::atomic<unsigned> m_batch_budget;
+
+    JobQueue m_job_queues[JOB_PRIORITY_COUNT];
+    // worker thread only
+    JobChain m_front_lanes[JOB_PRIORITY_COUNT];
+    std::atomic<int64_t> m_backlog_since_ns;
+
+    // resizing of an elastic group
+    std::atomic<bool> m_is_rehome_requested;
+    // a gated worker runs nothing until every former worker handed its moved jobs over
+    std::atomic<bool> m_is_gated;
+    std::atomic<bool> m_has_hand_overs;
+    std::mutex m_hand_over_mutex;
+    JobChain m_hand_over_lanes[JOB_PRIORITY_COUNT];
+    // the total is what parking and the capacity rely on, the lanes are only for monitoring,
+    // they share the cache line the producers write anyway
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_queue_size;
+    std::atomic<size_t> m_lane_sizes[JOB_PRIORITY_COUNT];
+    // set while the worker sleeps, so that only then a producer pays for a signal
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> m_is_parked;
+    WakeupEvent m_wakeup_event;
+    StealQueue m_steal_queue;
+    // worker thread only, the fraction of a job of the steal queue's share carried to the next batch
+    size_t m_steal_credit;
 
-    JobQueue m_job_queue;
-    std::mutex m_queue_mutex;
-    std::mutex m_null_mutex;
-    std::condition_variable m_queue_cond;
+    // backpressure, only full queues ever touch the waiters
+    size_t m_queue_capacity;
+    std::atomic<size_t> m_submit_waiter_count;
+    std::mutex m_submit_waiter_mutex;
+    SubmitAwaiter* m_submit_waiter_head;
+    SubmitAwaiter* m_submit_waiter_tail;
 
-    // integrate timer handling
+    // integrate timer handling, one of the two by m_timer_backend
+    TimerBackend m_timer_backend;
+    uint64_t m_timer_slack_ms;
+    TimerPool m_timer_pool;
     min_heap_t m_timer_heap;
+    TimerWheel m_timer_wheel;
+    MpscQueue<RemoteTimerNode> m_timer_mailbox;
+    std::atomic<bool> m_has_timer_requests;
+    // worker thread only, a job may step the worker again from inside a step
+    CppTimePoint m_loop_time;
+    int m_step_depth;
 
     std::atomic<bool> m_is_to_stop;
     std::atomic<bool> m_is_wait_stop;
     std::atomic<bool> m_is_stoped;
 };
+
+//-----------------------------------------
+// Awaitable submission of a job to a bounded worker.
+// If the queue is full, the awaiting coroutine is parked in the worker's FIFO of waiters,
+// and resumed on its own worker once the target has queued the job for it.
+//-----------------------------------------
+class SubmitAwaiter {
+public:
+    friend class Worker;
+
+    SubmitAwaiter(Worker* _worker, Job* _job, JobPriority _priority)
+        : m_worker(_worker),
+          m_job(_job),
+          m_priority(_priority),
+          m_resume_worker(nullptr),
+          m_resume_node(nullptr),
+          m_next(nullptr) {}
+    SubmitAwaiter(const SubmitAwaiter&) = delete;
+    SubmitAwaiter& operator=(const SubmitAwaiter&) = delete;
+    // a job that was never queued goes with the awaiter
+    ~SubmitAwaiter() { delete m_job; }
+
+    // NOLINTNEXTLINE
+    bool await_ready() {
+        if (!m_worker->TryAddJob(m_job, m_priority)) { return false; }
+        m_job = nullptr;
+        return true;
+    }
+    // NOLINTNEXTLINE
+    bool await_suspend(std::coroutine_handle<> _awaiting_coroutine) {
+        m_resume_worker = Worker::GetCurrentWorker();
+        assert(m_resume_worker != nullptr);
+        m_resume_node.m_handle = _awaiting_coroutine;
+        return m_worker->AddSubmitWaiter(this);
+    }
+    // NOLINTNEXTLINE
+    void await_resume() const noexcept {}
+
+private:
+    Worker* m_worker;
+    Job* m_job;
+    JobPriority m_priority;
+    Worker* m_resume_worker;
+    CoroutineNode m_resume_node;
+    SubmitAwaiter* m_next;
+};
+
+inline SubmitAwaiter Worker::AwaitAddJob(Job* _job, JobPriority _priority) {
+    return SubmitAwaiter(this, _job, _priority);
+}
+
+template <JobCallable Func>
+SubmitAwaiter Worker::AwaitAddJob(Func&& _func, JobPriority _priority) {
+    return SubmitAwaiter(this, new Job(std::forward<Func>(_func)), _priority);
+}
 }  // namespace nd
 
 #endif /* WORKER_H */
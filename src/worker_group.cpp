@@ -1,8 +1,12 @@
 #include "worker_group.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <vector>
 
+#include "loop_clock.hpp"
 #include "worker.hpp"
 
 using namespace std;
@@ -10,13 +14,29 @@ using namespace nd;
 
 //-----------------------------------------------------------------------------
 
-WorkerGroup::WorkerGroup(unsigned _group_id, const unsigned _thread_count, const std::string& _name)
-    : m_group_id(_group_id), m_thread_count(_thread_count), m_workers(NULL), m_name(_name), m_wait_stop(false) {}
+WorkerGroup::WorkerGroup(unsigned _group_id,
+                         const unsigned _thread_count,
+                         const std::string& _name,
+                         const WorkerGroupOptions& _options)
+    : m_group_id(_group_id),
+      m_thread_count(_thread_count),
+      m_min_thread_count(_thread_count),
+      m_max_thread_count(std::max(_thread_count, _options.m_max_thread_count)),
+      m_is_elastic(_thread_count > 0 && m_max_thread_count > _thread_count),
+      m_name(_name),
+      m_options(_options),
+      m_wait_stop(false),
+      m_rehome_count(0),
+      m_is_scaler_to_stop(false) {
+    if (m_is_elastic && m_options.m_session_router == nullptr) {
+        m_options.m_session_router = std::make_shared<JumpHashRouter>();
+    }
+}
 
 //-----------------------------------------------------------------------------
 
 WorkerGroup::~WorkerGroup() {
-    if (m_workers != nullptr) {
+    if (!m_workers.empty()) {
         if (m_wait_stop) {
             WaitStop();
         } else {
@@ -31,48 +51,312 @@ void WorkerGroup::Start(bool _to_wait_stop) {
     m_wait_stop = _to_wait_stop;
     if (0 == m_thread_count) { return; }
 
-    if (NULL != m_workers) { return; }
+    if (!m_workers.empty()) { return; }
+
+    m_cpus = ResolvePlacement(m_options.m_placement, m_max_thread_count);
+    m_workers.assign(m_max_thread_count, nullptr);
+    m_threads.resize(m_max_thread_count);
+    StartWorkers(0, m_thread_count);
+
+    if (m_is_elastic && m_options.m_grow_backlog_ms > 0) {
+        m_is_scaler_to_stop = false;
+        m_scaler_thread = thread(&WorkerGroup::ScalerMain, this);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::StartWorkers(unsigned _first, unsigned _last) {
+    for (unsigned i = _first; i < _last; i++) {
+        if (m_workers[i] != nullptr) { continue; }
+        m_threads[i] = thread(&WorkerGroup::WorkerThreadMain, this, i, m_cpus[i]);
+    }
+
+    // the workers can take jobs once they all exist
+    unique_lock<mutex> lock(m_start_mutex);
+    m_start_cond.wait(lock, [this, _first, _last]() {
+        for (unsigned i = _first; i < _last; i++) {
+            if (m_workers[i] == nullptr) { return false; }
+        }
+        return true;
+    });
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::WorkerThreadMain(unsigned _worker_id, int _cpu) {
+    // pin first, so that the worker is allocated and first touched on its own numa node
+    if (_cpu >= 0 && !PinCurrentThread(_cpu)) { _cpu = -1; }
 
-    m_workers = new Worker[m_thread_count];
-    m_threads.reserve(m_thread_count);
-    for (unsigned i = 0; i < m_thread_count; i++) {
-        m_workers[i].Init(m_group_id, i, m_thread_count, m_name);
-        m_threads.push_back(thread(&Worker::ThreadMain, &m_workers[i]));
+    Worker* worker = new Worker();
+    worker->Init(m_group_id, _worker_id, m_max_thread_count, m_name, m_options, this, _cpu);
+    {
+        // an idle worker steals right away, its siblings must exist by then
+        unique_lock<mutex> lock(m_start_mutex);
+        m_workers[_worker_id] = worker;
+        m_start_cond.notify_all();
+        m_start_cond.wait(lock, [this]() {
+            for (unsigned i = 0; i < GetThreadCount(); i++) {
+                if (m_workers[i] == nullptr) { return false; }
+            }
+            return true;
+        });
     }
+
+    worker->ThreadMain();
 }
 
 //-----------------------------------------------------------------------------
 
 void WorkerGroup::WaitStop() {
+    StopScaler();
     lock_guard<mutex> lock(m_stop_mutex);
-    if (NULL == m_workers) { return; }
+    if (m_workers.empty()) { return; }
 
+    // the retired workers too, they may still resume coroutines
     unsigned int thread_index = 0;
     while (true) {
         /* check the worker once only */
-        if (thread_index < m_thread_count && m_workers[thread_index].IsJobQueueEmpty()) {
-            m_workers[thread_index].WaitStop();
+        if (thread_index < m_max_thread_count &&
+            (m_workers[thread_index] == nullptr || m_workers[thread_index]->IsJobQueueEmpty())) {
+            if (m_workers[thread_index] != nullptr) { m_workers[thread_index]->WaitStop(); }
             thread_index++;
         }
-        if (thread_index == m_thread_count) { break; }
+        if (thread_index == m_max_thread_count) { break; }
 
         this_thread::sleep_for(chrono::milliseconds(1));
     }
-    for (unsigned i = 0; i < m_thread_count; i++) { m_threads[i].join(); }
-    delete[] m_workers;
-    m_workers = NULL;
+    for (auto& worker_thread : m_threads) {
+        if (worker_thread.joinable()) { worker_thread.join(); }
+    }
+    DeleteWorkers();
 }
 
 //-----------------------------------------------------------------------------
 
 void WorkerGroup::Stop() {
+    StopScaler();
+    lock_guard<mutex> lock(m_stop_mutex);
+    if (m_workers.empty()) { return; }
+
+    for (Worker* worker : m_workers) {
+        if (worker != nullptr) { worker->Stop(); }
+    }
+    for (auto& worker_thread : m_threads) {
+        if (worker_thread.joinable()) { worker_thread.join(); }
+    }
+    DeleteWorkers();
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::DeleteWorkers() {
+    for (Worker* worker : m_workers) { delete worker; }
+    m_workers.clear();
+    m_threads.clear();
+    m_thread_count = m_min_thread_count;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned WorkerGroup::Resize(unsigned _thread_count) {
+    lock_guard<mutex> lock(m_stop_mutex);
+    return InternalResize(_thread_count);
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned WorkerGroup::InternalResize(unsigned _thread_count) {
+    unsigned old_count = GetThreadCount();
+    if (!m_is_elastic || m_workers.empty()) { return old_count; }
+
+    unsigned new_count = std::clamp(_thread_count, 1u, m_max_thread_count);
+    if (new_count == old_count) { return old_count; }
+    StartWorkers(old_count, new_count);
+
+    // the others keep running, a grow with jump hashing gates the new workers only
+    const SessionRouter* router = m_options.m_session_router.get();
+    auto may_gain = [&](unsigned _worker_id) { return router->MayGainSessions(_worker_id, old_count, new_count); };
+    {
+        // no producer is half way through routing while the mapping changes,
+        // the lock is not held over the wait below, the workers may be producers of this group too
+        unique_lock<shared_mutex> routing_lock(m_resize_mutex);
+        m_thread_count.store(new_count, std::memory_order_release);
+        {
+            lock_guard<mutex> lock(m_rehome_mutex);
+            m_rehome_count = old_count;
+        }
+        // the new owner of a moved session must not run its newer jobs before the older ones arrive
+        for (unsigned i = 0; i < new_count; i++) {
+            if (may_gain(i)) { m_workers[i]->m_is_gated.store(true, std::memory_order_seq_cst); }
+        }
+        // every former worker may hold jobs of a moved session, it hands them over on its own thread
+        for (unsigned i = 0; i < old_count; i++) {
+            m_workers[i]->m_is_rehome_requested.store(true, std::memory_order_seq_cst);
+            m_workers[i]->WakeUp();
+        }
+    }
+    {
+        unique_lock<mutex> lock(m_rehome_mutex);
+        m_rehome_cond.wait(lock, [this]() { return m_rehome_count == 0; });
+    }
+    for (unsigned i = 0; i < new_count; i++) {
+        if (!may_gain(i)) { continue; }
+        m_workers[i]->m_is_gated.store(false, std::memory_order_seq_cst);
+        m_workers[i]->WakeUp();
+    }
+    return new_count;
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::OnWorkerRehomed() {
+    lock_guard<mutex> lock(m_rehome_mutex);
+    if (--m_rehome_count == 0) { m_rehome_cond.notify_one(); }
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::ScalerMain() {
+    const auto interval = chrono::milliseconds(std::max(1u, m_options.m_grow_backlog_ms / 4));
+    auto idle_since = LoopClock::Now();
+    unique_lock<mutex> lock(m_scaler_mutex);
+    while (!m_scaler_cond.wait_for(lock, interval, [this]() { return m_is_scaler_to_stop; })) {
+        unsigned thread_count = GetThreadCount();
+        int64_t backlog_age = 0;
+        for (unsigned i = 0; i < thread_count; i++) {
+            backlog_age = std::max(backlog_age, m_workers[i]->GetBacklogAgeMs());
+        }
+
+        auto now = LoopClock::Now();
+        if (backlog_age < interval.count()) {
+            if (thread_count > m_min_thread_count && now - idle_since >= chrono::milliseconds(m_options.m_shrink_idle_ms)) {
+                Resize(thread_count - 1);
+                idle_since = now;
+            }
+            continue;
+        }
+
+        idle_since = now;
+        if (backlog_age >= m_options.m_grow_backlog_ms && thread_count < m_max_thread_count) {
+            Resize(thread_count + 1);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::StopScaler() {
+    if (!m_scaler_thread.joinable()) { return; }
+    {
+        lock_guard<mutex> lock(m_scaler_mutex);
+        m_is_scaler_to_stop = true;
+    }
+    m_scaler_cond.notify_one();
+    m_scaler_thread.join();
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::SetBatchBudget(unsigned _batch_budget) {
     lock_guard<mutex> lock(m_stop_mutex);
-    if (NULL == m_workers) { return; }
+    m_options.m_batch_budget = _batch_budget;
+    if (m_workers.empty()) { return; }
+
+    for (Worker* worker : m_workers) {
+        if (worker != nullptr) { worker->SetBatchBudget(_batch_budget); }
+    }
+}
+
+//-----------------------------------------------------------------------------
 
-    for (unsigned i = 0; i < m_thread_count; i++) { m_workers[i].Stop(); }
-    for (unsigned i = 0; i < m_thread_count; i++) { m_threads[i].join(); }
-    delete[] m_workers;
-    m_workers = NULL;
+Worker* WorkerGroup::NextWorker() {
+    // per producer state, no shared counter to bounce around
+    thread_local unsigned s_next_worker = 0;
+    unsigned thread_count = GetThreadCount();
+    if (m_options.m_any_session_routing == AnySessionRouting::RoundRobin || thread_count < 2) {
+        return m_workers[s_next_worker++ % thread_count];
+    }
+
+    // two distinct random workers, the shorter queue wins
+    // splitmix64 sequence seeded per thread
+    thread_local uint64_t s_random_state = std::hash<std::thread::id>()(std::this_thread::get_id());
+    s_random_state += 0x9e3779b97f4a7c15ULL;
+    uint64_t random = HashRouter::Mix(s_random_state);
+    unsigned first = static_cast<unsigned>(((random >> 32) * thread_count) >> 32);
+    unsigned second = static_cast<unsigned>(((random & 0xffffffff) * (thread_count - 1)) >> 32);
+    if (second >= first) { second++; }
+    Worker* first_worker = m_workers[first];
+    Worker* second_worker = m_workers[second];
+    return first_worker->GetQueueSize() <= second_worker->GetQueueSize() ? first_worker : second_worker;
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::AddAnySessionJob(Job* _job, JobPriority _priority) {
+    Worker* target = NextWorker();
+    // the steal queues have no lanes, only normal jobs are shared
+    if (!m_options.m_work_stealing || _priority != JobPriority::Normal) { return target->AddJob(_job, _priority); }
+    if (target->AddStealableJob(_job)) { return; }
+
+    // the target is busy, get an idle sibling to come and steal
+    unsigned thread_count = GetThreadCount();
+    for (unsigned i = 0; i < thread_count; i++) {
+        Worker* sibling = m_workers[i];
+        if (sibling == target || !sibling->m_is_parked.load(std::memory_order_seq_cst)) { continue; }
+        sibling->WakeUp();
+        return;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void WorkerGroup::AddJobs(std::span<const SessionJob> _jobs, JobPriority _priority) {
+    RoutingLock lock = LockRouting();
+    unsigned thread_count = GetThreadCount();
+    // one chain per worker, then one more per worker for its stealable jobs
+    bool is_stealing = m_options.m_work_stealing && _priority == JobPriority::Normal;
+    std::vector<JobChain> chains(is_stealing ? thread_count * 2 : thread_count);
+    for (const SessionJob& session_job : _jobs) {
+        session_job.m_job->m_session_id = session_job.m_session_id;
+        if (session_job.m_session_id != ANY_SESSION) {
+            chains[GetWorker(session_job.m_session_id)->m_worker_id].Append(session_job.m_job);
+            continue;
+        }
+        size_t index = NextWorker()->m_worker_id;
+        chains[is_stealing ? thread_count + index : index].Append(session_job.m_job);
+    }
+
+    for (unsigned i = 0; i < thread_count; i++) {
+        JobChain& chain = chains[i];
+        if (chain.IsEmpty()) { continue; }
+        // only jobs are appended
+        m_workers[i]->AddJobChain(static_cast<Job*>(chain.m_first), static_cast<Job*>(chain.m_last), chain.m_count,
+                                  _priority);
+    }
+    if (!is_stealing) { return; }
+    for (unsigned i = 0; i < thread_count; i++) {
+        JobChain& chain = chains[thread_count + i];
+        if (chain.IsEmpty()) { continue; }
+        m_workers[i]->AddStealableJobChain(static_cast<Job*>(chain.m_first), static_cast<Job*>(chain.m_last),
+                                           chain.m_count);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+size_t WorkerGroup::Steal(Worker* _thief) {
+    unsigned thread_count = GetThreadCount();
+    if (!m_options.m_work_stealing || thread_count < 2) { return 0; }
+
+    unsigned start = _thief->m_worker_id + 1;
+    for (unsigned i = 0; i < thread_count; i++) {
+        Worker* victim = m_workers[(start + i) % thread_count];
+        if (victim == _thief) { continue; }
+        size_t count = victim->m_steal_queue.StealHalfInto(_thief->m_steal_queue);
+        if (count > 0) { return count; }
+    }
+    return 0;
 }
 
 //-----------------------------------------------------------------------------
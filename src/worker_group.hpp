@@ -1,10 +1,15 @@
 #ifndef WORKER_GROUP_H
 #define WORKER_GROUP_H
 
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "session_router.hpp"
 #include "singleton.hpp"
 #include "worker.hpp"
 #include "worker_types.hpp"
@@ -20,7 +25,10 @@ public:
     // template<WorkerGroup theGroup>
     // static void process(SessionId theId, Job* job);
 
-    WorkerGroup(unsigned _group_id, unsigned _thread_count, const std::string& _name = "xxx");
+    WorkerGroup(unsigned _group_id,
+                unsigned _thread_count,
+                const std::string& _name = "xxx",
+                const WorkerGroupOptions& _options = {});
     ~WorkerGroup();
 
     void Start(bool _to_wait_stop = false);
@@ -28,27 +36,142 @@ public:
     void WaitStop();
     void Stop();
 
+    // an elastic group only, must not be called in its workers either.
+    // the queued jobs of the sessions which move follow them before any new job is routed,
+    // only the workers which may gain sessions wait for them meanwhile.
+    // a retired worker stays parked, it still resumes the coroutines which were running on it,
+    // so its thread is never reclaimed before Stop() or WaitStop().
+    // returns the thread count now in use
+    unsigned Resize(unsigned _thread_count);
+    unsigned GetThreadCount() const { return m_thread_count.load(std::memory_order_acquire); }
+
+    // ANY_SESSION gives the next worker in turn, as for its jobs
     Worker* GetWorker(const size_t _session_id) {
-        if (NULL == m_workers) { return NULL; }
-        unsigned worker_id = _session_id % m_thread_count;
-        return &m_workers[worker_id];
+        if (m_workers.empty()) { return NULL; }
+        if (_session_id == ANY_SESSION) { return NextWorker(); }
+        unsigned thread_count = GetThreadCount();
+        const SessionRouter* router = m_options.m_session_router.get();
+        unsigned worker_id =
+            router == nullptr ? _session_id % thread_count : router->Route(_session_id, thread_count);
+        return m_workers[worker_id];
+    }
+
+    // on the worker thread of the session only, AddTimer() from any other thread.
+    // the timer stays with the worker which added it, a resize may route the session elsewhere meanwhile,
+    // so it is cancelled on the current worker, which has to be that one
+    TimerHandle AddLocalTimer(const SessionId _id,
+                              const unsigned long long _ms_time,
+                              TimerCallback _callback,
+                              uint64_t _slack_ms = DEFAULT_TIMER_SLACK) {
+        return GetSessionWorker(_id)->AddLocalTimer(_ms_time, std::move(_callback), _slack_ms);
+    }
+    void CancelLocalTimer(const SessionId _id, TimerHandle& _event) {
+        return GetSessionWorker(_id)->CancelLocalTimer(_event);
+    }
+    // from any thread, the callback runs on the worker of the session
+    RemoteTimer AddTimer(const SessionId _id,
+                         const unsigned long long _ms_time,
+                         TimerCallback _callback,
+                         uint64_t _slack_ms = DEFAULT_TIMER_SLACK) {
+        return GetWorker(_id)->AddRemoteTimer(_ms_time, std::move(_callback), _slack_ms);
     }
 
-    TimerHandle AddLocalTimer(const SessionId _id, const unsigned long long _ms_time, TimerCallback _callback) {
-        return GetWorker(_id)->AddLocalTimer(_ms_time, _callback);
+    void AddJob(const SessionId _id, Job* _job, JobPriority _priority = JobPriority::Normal) {
+        if (_id == ANY_SESSION) { return AddAnySessionJob(_job, _priority); }
+        RoutingLock lock = LockRouting();
+        _job->m_session_id = _id;
+        GetWorker(_id)->AddJob(_job, _priority);
+    }
+    template <JobCallable Func>
+    void AddJob(const SessionId _id, Func&& _func, JobPriority _priority = JobPriority::Normal) {
+        AddJob(_id, new Job(std::forward<Func>(_func)), _priority);
+    }
+
+    // groups the jobs by worker, each worker gets one queue operation and at most one wakeup,
+    // the order of the jobs of a session is kept
+    void AddJobs(std::span<const SessionJob> _jobs, JobPriority _priority = JobPriority::Normal);
+
+    // bounded by WorkerGroupOptions::m_queue_capacity, ANY_SESSION picks the next worker in turn
+    bool TryAddJob(const SessionId _id, Job* _job, JobPriority _priority = JobPriority::Normal) {
+        RoutingLock lock = LockRouting();
+        _job->m_session_id = _id;
+        return GetWorker(_id)->TryAddJob(_job, _priority);
     }
-    void CancelLocalTimer(const SessionId _id, TimerHandle& _event) { return GetWorker(_id)->CancelLocalTimer(_event); }
+    // an awaiting submission keeps the worker it was routed to, even across a resize
+    SubmitAwaiter AwaitAddJob(const SessionId _id, Job* _job, JobPriority _priority = JobPriority::Normal) {
+        RoutingLock lock = LockRouting();
+        _job->m_session_id = _id;
+        return GetWorker(_id)->AwaitAddJob(_job, _priority);
+    }
+    template <JobCallable Func>
+    SubmitAwaiter AwaitAddJob(const SessionId _id, Func&& _func, JobPriority _priority = JobPriority::Normal) {
+        return AwaitAddJob(_id, new Job(std::forward<Func>(_func)), _priority);
+    }
+
+    // called by an idle _thief, moves a share of a sibling's session-less jobs to it
+    size_t Steal(Worker* _thief);
 
-    void AddJob(const SessionId _id, Job* _job) { GetWorker(_id)->AddJob(_job); }
+    // trade timer latency(larger) against per job overhead(smaller) at runtime
+    void SetBatchBudget(unsigned _batch_budget);
 
 private:
+    friend class Worker;
+    using RoutingLock = std::shared_lock<std::shared_mutex>;
+
+    // producers of an elastic group route under a shared lock, a fixed group takes none
+    RoutingLock LockRouting() {
+        return m_is_elastic ? RoutingLock(m_resize_mutex) : RoutingLock(m_resize_mutex, std::defer_lock);
+    }
+    void AddAnySessionJob(Job* _job, JobPriority _priority);
+    // where the next ANY_SESSION job goes
+    Worker* NextWorker();
+    // the current worker, which must run the jobs of the session,
+    // a job of an elastic group may still run on the worker it was routed to before a resize
+    Worker* GetSessionWorker([[maybe_unused]] const SessionId _id) {
+        Worker* worker = Worker::GetCurrentWorker();
+        assert(worker->m_group == this && (m_is_elastic || _id == ANY_SESSION || worker == GetWorker(_id)));
+        return worker;
+    }
+
+    // starts the threads of the slots [_first, _last) and waits for their workers
+    void StartWorkers(unsigned _first, unsigned _last);
+    // pins the thread, then allocates and runs the worker on it
+    void WorkerThreadMain(unsigned _worker_id, int _cpu);
+    // once the threads are joined
+    void DeleteWorkers();
+    // with m_stop_mutex held
+    unsigned InternalResize(unsigned _thread_count);
+    // on a worker thread, once its Rehome() is done
+    void OnWorkerRehomed();
+    void ScalerMain();
+    void StopScaler();
+
     unsigned m_group_id;
-    unsigned m_thread_count;
-    Worker* m_workers;
+    // the workers the jobs are routed to, the slots above hold retired workers or nothing yet
+    std::atomic<unsigned> m_thread_count;
+    unsigned m_min_thread_count;
+    unsigned m_max_thread_count;
+    bool m_is_elastic;
+    // sized to m_max_thread_count once started, so that the producers never see it move
+    std::vector<Worker*> m_workers;
     std::vector<std::thread> m_threads;
+    std::vector<int> m_cpus;
     std::string m_name;
+    WorkerGroupOptions m_options;
     bool m_wait_stop;
     std::mutex m_stop_mutex;
+    std::mutex m_start_mutex;
+    std::condition_variable m_start_cond;
+    std::shared_mutex m_resize_mutex;
+    std::mutex m_rehome_mutex;
+    std::condition_variable m_rehome_cond;
+    unsigned m_rehome_count;
+
+    // autoscaling of an elastic group
+    std::thread m_scaler_thread;
+    std::mutex m_scaler_mutex;
+    std::condition_variable m_scaler_cond;
+    bool m_is_scaler_to_stop;
 };
 
 // template<WorkerGroup theGroup>
@@ -25,11 +25,14 @@ public:
         memset(m_worker_groups, 0, sizeof(WorkerGroup*) * m_max_worker_group);
     }
 
-    void Start(unsigned _worker_group_id, signed _processor_num, const std::string& _the_name = "xxx") {
+    void Start(unsigned _worker_group_id,
+               signed _processor_num,
+               const std::string& _the_name = "xxx",
+               const WorkerGroupOptions& _options = {}) {
         assert(_worker_group_id < m_max_worker_group);
         assert(m_worker_groups[_worker_group_id] == nullptr);
 
-        m_worker_groups[_worker_group_id] = new WorkerGroup(_worker_group_id, _processor_num, _the_name);
+        m_worker_groups[_worker_group_id] = new WorkerGroup(_worker_group_id, _processor_num, _the_name, _options);
         m_worker_groups[_worker_group_id]->Start();
     }
 
@@ -65,18 +68,95 @@ public:
         return m_worker_groups[_worker_group_id]->GetWorker(_session_id);
     }
 
-    void RunOnWorkerGroup(int _worker_group_id, size_t _session_id, Job* _job) {
-        if (_worker_group_id == PreDefWorkerGroup::Main) { return RunOnMainThread(_job); }
-        if (_worker_group_id == PreDefWorkerGroup::Current) { return RunOnCurrentThread(_job); }
+    void RunOnWorkerGroup(int _worker_group_id,
+                          size_t _session_id,
+                          Job* _job,
+                          JobPriority _priority = JobPriority::Normal) {
+        if (_worker_group_id == PreDefWorkerGroup::Main) { return RunOnMainThread(_job, _priority); }
+        if (_worker_group_id == PreDefWorkerGroup::Current) { return RunOnCurrentThread(_job, _priority); }
 
         assert(0 <= _worker_group_id && _worker_group_id < m_max_worker_group);
         assert(m_worker_groups[_worker_group_id] != nullptr);
-        m_worker_groups[_worker_group_id]->AddJob(_session_id, _job);
+        m_worker_groups[_worker_group_id]->AddJob(_session_id, _job, _priority);
     }
 
-    static void RunOnMainThread(Job* _job) { Worker::GetMainWorker()->AddJob(_job); }
+    template <JobCallable Func>
+    void RunOnWorkerGroup(int _worker_group_id,
+                          size_t _session_id,
+                          Func&& _func,
+                          JobPriority _priority = JobPriority::Normal) {
+        RunOnWorkerGroup(_worker_group_id, _session_id, new Job(std::forward<Func>(_func)), _priority);
+    }
+
+    // fan out in bulk, see WorkerGroup::AddJobs()
+    void RunOnWorkerGroup(int _worker_group_id,
+                          std::span<const SessionJob> _jobs,
+                          JobPriority _priority = JobPriority::Normal) {
+        if (_worker_group_id == PreDefWorkerGroup::Main) { return Worker::GetMainWorker()->AddJobs(_jobs, _priority); }
+        if (_worker_group_id == PreDefWorkerGroup::Current) {
+            return Worker::GetCurrentWorker()->AddJobs(_jobs, _priority);
+        }
+
+        assert(0 <= _worker_group_id && static_cast<size_t>(_worker_group_id) < m_max_worker_group);
+        assert(m_worker_groups[_worker_group_id] != nullptr);
+        m_worker_groups[_worker_group_id]->AddJobs(_jobs, _priority);
+    }
+
+    // returns false if the target worker is at capacity, the job then stays with the caller
+    bool TryRunOnWorkerGroup(int _worker_group_id,
+                             size_t _session_id,
+                             Job* _job,
+                             JobPriority _priority = JobPriority::Normal) {
+        if (_worker_group_id == PreDefWorkerGroup::Main) { return Worker::GetMainWorker()->TryAddJob(_job, _priority); }
+        if (_worker_group_id == PreDefWorkerGroup::Current) {
+            return Worker::GetCurrentWorker()->TryAddJob(_job, _priority);
+        }
+
+        assert(0 <= _worker_group_id && static_cast<size_t>(_worker_group_id) < m_max_worker_group);
+        assert(m_worker_groups[_worker_group_id] != nullptr);
+        return m_worker_groups[_worker_group_id]->TryAddJob(_session_id, _job, _priority);
+    }
+
+    // co_await g_worker_mgr->AwaitRunOnWorkerGroup(...) suspends the coroutine while the target is full
+    template <JobCallable Func>
+    SubmitAwaiter AwaitRunOnWorkerGroup(int _worker_group_id,
+                                        size_t _session_id,
+                                        Func&& _func,
+                                        JobPriority _priority = JobPriority::Normal) {
+        if (_worker_group_id == PreDefWorkerGroup::Main) {
+            return Worker::GetMainWorker()->AwaitAddJob(std::forward<Func>(_func), _priority);
+        }
+        if (_worker_group_id == PreDefWorkerGroup::Current) {
+            return Worker::GetCurrentWorker()->AwaitAddJob(std::forward<Func>(_func), _priority);
+        }
 
-    static void RunOnCurrentThread(Job* _job) { Worker::GetCurrentWorker()->AddJob(_job); }
+        assert(0 <= _worker_group_id && static_cast<size_t>(_worker_group_id) < m_max_worker_group);
+        assert(m_worker_groups[_worker_group_id] != nullptr);
+        return m_worker_groups[_worker_group_id]->AwaitAddJob(_session_id, std::forward<Func>(_func), _priority);
+    }
+
+    WorkerGroup* GetWorkerGroup(unsigned _worker_group_id) {
+        assert(_worker_group_id < m_max_worker_group);
+        return m_worker_groups[_worker_group_id];
+    }
+
+    static void RunOnMainThread(Job* _job, JobPriority _priority = JobPriority::Normal) {
+        Worker::GetMainWorker()->AddJob(_job, _priority);
+    }
+
+    static void RunOnCurrentThread(Job* _job, JobPriority _priority = JobPriority::Normal) {
+        Worker::GetCurrentWorker()->AddJob(_job, _priority);
+    }
+
+    template <JobCallable Func>
+    static void RunOnMainThread(Func&& _func, JobPriority _priority = JobPriority::Normal) {
+        Worker::GetMainWorker()->AddJob(std::forward<Func>(_func), _priority);
+    }
+
+    template <JobCallable Func>
+    static void RunOnCurrentThread(Func&& _func, JobPriority _priority = JobPriority::Normal) {
+        Worker::GetCurrentWorker()->AddJob(std::forward<Func>(_func), _priority);
+    }
 
 protected:
     size_t m_max_worker_group;
@@ -3,14 +3,183 @@
 
 #include <stdint.h>
 
-#include <functional>
-#include <list>
+#include <cassert>
+#include <coroutine>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "block_pool.hpp"
+#include "inline_function.hpp"
+#include "mpsc_queue.hpp"
+#include "placement.hpp"
 
 namespace nd {
 using ProcessWorkerId = int32_t;
 using SessionId = uint64_t;
-using Job = std::function<void()>;
-using JobQueue = std::list<Job*>;
+
+// a job submitted without a session may run on any worker of the group,
+// whether the group steals or not, so this id is reserved and never a real session:
+// each use of it picks a worker as AnySessionRouting says, no two have to agree
+constexpr SessionId ANY_SESSION = UINT64_MAX;
+
+// captures up to this size(a shared_ptr plus a couple of words) are stored inline
+constexpr size_t JOB_INLINE_SIZE = 48;
+using JobFunction = InlineFunction<JOB_INLINE_SIZE>;
+
+enum class JobKind : uint8_t {
+    Callable,   // Job
+    Coroutine,  // CoroutineNode
+};
+
+// everything a worker's run queue holds, tagged with what to do with it
+struct JobNode : public MpscNode {
+    explicit JobNode(JobKind _kind) : m_kind(_kind) {}
+    JobKind m_kind;
+};
+
+// a callable which links itself into the worker's run queue.
+// new/delete come from a per thread block pool, so a job whose capture fits
+// JOB_INLINE_SIZE costs no malloc at all in steady state.
+class Job final : public JobNode {
+public:
+    template <typename Func>
+        requires(!std::is_same_v<std::decay_t<Func>, Job>)
+    Job(Func&& _func) : JobNode(JobKind::Callable), m_session_id(UINT64_MAX), m_func(std::forward<Func>(_func)) {}
+    Job(const Job&) = delete;
+    Job& operator=(const Job&) = delete;
+
+    void operator()() { m_func(); }
+
+    static void* operator new(size_t _size) {
+        assert(_size == sizeof(Job));
+        return BlockPool<sizeof(Job)>::Allocate();
+    }
+    static void operator delete(void* _ptr) { BlockPool<sizeof(Job)>::Free(_ptr); }
+
+    // set by the group which routed the job, so that a resize can move it along with its session
+    SessionId m_session_id;
+
+private:
+    JobFunction m_func;
+};
+
+// a pending resume, embedded in whoever waits for the coroutine,
+// so resuming on another worker is a single push without any allocation.
+// it can be queued once at a time, which holds as a coroutine is resumed once per suspension.
+struct CoroutineNode : public JobNode {
+    CoroutineNode() : JobNode(JobKind::Coroutine) {}
+    explicit CoroutineNode(std::coroutine_handle<> _handle) : JobNode(JobKind::Coroutine), m_handle(_handle) {}
+    CoroutineNode(const CoroutineNode&) = delete;
+    CoroutineNode& operator=(const CoroutineNode&) = delete;
+
+    std::coroutine_handle<> m_handle;
+};
+
+using JobQueue = MpscQueue<JobNode>;
+
+// a FIFO of nodes linked through m_next, owned by a single thread
+struct JobChain {
+    JobNode* m_first = nullptr;
+    JobNode* m_last = nullptr;
+    size_t m_count = 0;
+
+    bool IsEmpty() const { return m_first == nullptr; }
+    void Append(JobNode* _node) {
+        _node->m_next.store(nullptr, std::memory_order_relaxed);
+        if (m_last == nullptr) {
+            m_first = _node;
+        } else {
+            m_last->m_next.store(_node, std::memory_order_relaxed);
+        }
+        m_last = _node;
+        m_count++;
+    }
+    JobNode* PopFront() {
+        JobNode* node = m_first;
+        if (node == nullptr) { return nullptr; }
+        m_first = static_cast<JobNode*>(node->m_next.load(std::memory_order_relaxed));
+        if (m_first == nullptr) { m_last = nullptr; }
+        m_count--;
+        return node;
+    }
+};
+
+// one entry of a bulk submission
+struct SessionJob {
+    SessionId m_session_id;
+    Job* m_job;
+};
+
+// every worker keeps one queue(lane) per priority
+enum class JobPriority : uint8_t {
+    High = 0,  // continuations of the coroutines in flight, so that they finish before new work is admitted
+    Normal,
+    Low,  // bulk background work
+
+    Count,
+};
+constexpr size_t JOB_PRIORITY_COUNT = static_cast<size_t>(JobPriority::Count);
+// jobs taken from each lane per drain round, a non-empty lane gets at least one job a round, so none starves
+constexpr unsigned JOB_LANE_WEIGHTS[JOB_PRIORITY_COUNT] = {8, 4, 1};
+// the share of every batch the session-less jobs of a worker get against the lanes
+constexpr unsigned STEAL_QUEUE_WEIGHT = 4;
+constexpr unsigned BATCH_WEIGHT_TOTAL =
+    JOB_LANE_WEIGHTS[0] + JOB_LANE_WEIGHTS[1] + JOB_LANE_WEIGHTS[2] + STEAL_QUEUE_WEIGHT;
+
+// the callables AddJob accepts besides a ready made Job*
+template <typename Func>
+concept JobCallable = std::is_invocable_v<std::decay_t<Func>&> && !std::is_convertible_v<Func, Job*>;
+
+class SessionRouter;
+
+// where a group puts the ANY_SESSION jobs
+enum class AnySessionRouting : uint8_t {
+    RoundRobin,
+    // the less loaded of two random workers(power of two choices)
+    LeastLoaded,
+};
+
+// jobs a worker runs back to back before it looks at its timers again
+constexpr unsigned DEFAULT_BATCH_BUDGET = 64;
+
+// where a worker keeps its local timers
+enum class TimerBackend {
+    // exact deadlines, O(log n) add and cancel
+    Heap,
+    // 1 ms ticks, O(1) add and cancel and expiry by whole slots, for lots of mostly cancelled timeouts
+    Wheel,
+};
+
+// slack of a timer which takes the one of its worker
+constexpr uint64_t DEFAULT_TIMER_SLACK = UINT64_MAX;
+
+// tunables shared by all the workers of a group
+struct WorkerGroupOptions {
+    // 1 checks the timers after every single job
+    unsigned m_batch_budget = DEFAULT_BATCH_BUDGET;
+    // ANY_SESSION jobs go to per worker queues which idle siblings steal from,
+    // session jobs keep their strict per session order either way
+    bool m_work_stealing = false;
+    // jobs a worker queues at most through TryAddJob()/AwaitAddJob(), 0 for unbounded,
+    // AddJob() and coroutine resumes are never refused
+    size_t m_queue_capacity = 0;
+    // nullptr keeps _session_id % thread count, see session_router.hpp for the others
+    std::shared_ptr<const SessionRouter> m_session_router;
+    AnySessionRouting m_any_session_routing = AnySessionRouting::RoundRobin;
+    // cpu pinning, which also decides the numa node each worker allocates on
+    PlacementSpec m_placement;
+    // an elastic group runs between its initial thread count and this many threads, 0 keeps it fixed,
+    // it routes with the jump consistent hash unless told otherwise, so that a resize moves few sessions
+    unsigned m_max_thread_count = 0;
+    // grows by a thread once a worker has been behind its queue this long, 0 leaves it to Resize()
+    unsigned m_grow_backlog_ms = 0;
+    // shrinks by a thread once no worker has been behind for this long
+    unsigned m_shrink_idle_ms = 10000;
+    TimerBackend m_timer_backend = TimerBackend::Heap;
+    // how late in ms a timer may fire by default, so that close deadlines share one wakeup, 0 for exact
+    uint64_t m_timer_slack_ms = 0;
+};
 
 namespace PreDefWorkerGroup {  // NOLINT
 enum {
@@ -1,14 +1,37 @@
+#ifdef __linux__
+#include <poll.h>
+#endif
+
+#include <algorithm>
 #include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "log.hpp"
 #include "task.hpp"
 #include "time_waiter.hpp"
+#include "when_all.hpp"
 #include "worker_manager.hpp"
 
 using namespace std;
 
+// counts the global allocations made by the current thread
+thread_local size_t g_thread_alloc_count = 0;
+
+void* operator new(size_t _size) {
+    g_thread_alloc_count++;
+    void* ptr = malloc(_size > 0 ? _size : 1);
+    if (ptr == nullptr) { throw std::bad_alloc(); }
+    return ptr;
+}
+void operator delete(void* _ptr) noexcept { free(_ptr); }
+void operator delete(void* _ptr, size_t) noexcept { free(_ptr); }
+
 // usage 1 : define worker group(thread model)
 // NOLINTNEXTLINE
 namespace WorkerGroup {
@@ -40,22 +63,27 @@ protected:
 TEST_F(CoroutinesCppMtTest, TypeSize) {
     LOG_TRACE("----------------------------------------");
     LOG_TRACE("sizeof nd::CoroutineController<void> = " << sizeof(nd::CoroutineController<void>));
-    LOG_TRACE("\tsizeof nd::ID<CoroutineController<void>> = " << sizeof(nd::ID<nd::CoroutineController<void>>));
-    LOG_TRACE("\tsizeof std::list<CoroutineController<void>::WaitingTask> = "
-              << sizeof(std::list<nd::CoroutineController<void>::WaitingTask>));
-    LOG_TRACE("\tsizeof std::mutex = " << sizeof(std::mutex));
-    LOG_TRACE("\tsizeof std::coroutine_handle<> = " << sizeof(std::coroutine_handle<>));
-    LOG_TRACE("----------------------------------------");
+    LOG_TRACE("\tsizeof nd::CoroutineNode = " << sizeof(nd::CoroutineNode));
+    LOG_TRACE("\tsizeof std::exception_ptr = " << sizeof(std::exception_ptr));
     LOG_TRACE("sizeof nd::CoroutineController<char> = " << sizeof(nd::CoroutineController<char>));
-    LOG_TRACE("\tsizeof nd::ID<CoroutineController<char>> = " << sizeof(nd::ID<nd::CoroutineController<char>>));
-    LOG_TRACE("\tsizeof std::list<CoroutineController<char>::WaitingTask> = "
-              << sizeof(std::list<nd::CoroutineController<char>::WaitingTask>));
-    LOG_TRACE("\tsizeof std::mutex = " << sizeof(std::mutex));
-    LOG_TRACE("\tsizeof std::coroutine_handle<> = " << sizeof(std::coroutine_handle<>));
-    LOG_TRACE("\tsizeof char = " << sizeof(char));
+    LOG_TRACE("sizeof nd::TaskPromise<void> = " << sizeof(nd::TaskPromise<void>));
+    LOG_TRACE("sizeof nd::TaskWaiter = " << sizeof(nd::TaskWaiter));
+    LOG_TRACE("sizeof nd::Task<> = " << sizeof(nd::Task<>));
     LOG_TRACE("----------------------------------------");
     EXPECT_EQ(sizeof(nd::CoroutineController<void>) + sizeof(size_t), sizeof(nd::CoroutineController<char>));
     EXPECT_EQ(sizeof(nd::CoroutineController<void>) + sizeof(size_t), sizeof(nd::CoroutineController<size_t>));
+
+    // the state lives in the frame, the handle is a single pointer
+    EXPECT_EQ(sizeof(nd::Task<>), sizeof(void*));
+    EXPECT_EQ(sizeof(nd::Task<std::string>), sizeof(void*));
+    EXPECT_EQ(sizeof(nd::TaskPromise<void>), sizeof(nd::CoroutineController<void>));
+    // no vtable anywhere
+    EXPECT_FALSE(std::is_polymorphic_v<nd::TaskPromise<void>>);
+    EXPECT_FALSE(std::is_polymorphic_v<nd::TaskPromise<int>>);
+    EXPECT_FALSE(std::is_polymorphic_v<nd::Task<int>>);
+    // the resume node, the state word with the waiters, the ref count and the exception
+    EXPECT_EQ(sizeof(nd::CoroutineController<void>),
+              sizeof(nd::CoroutineNode) + sizeof(uintptr_t) + sizeof(uint64_t) + sizeof(std::exception_ptr));
 }
 
 TEST_F(CoroutinesCppMtTest, Wait_Bg_Task_On_Main_Thread) {
@@ -218,3 +246,1069 @@ TEST_F(CoroutinesCppMtTest, HandleExceptionFromTask) {
     main_task.WaitInMain();
     nd::Worker::GetMainWorker()->WaitUntilEmpty();
 }
+
+// a big result which counts its copies, and has no default constructor
+struct Payload {
+    explicit Payload(size_t _size) : m_data(_size, 'x') {}
+    Payload(const Payload& _other) : m_data(_other.m_data) { s_copy_count++; }
+    Payload(Payload&&) noexcept = default;
+
+    static inline std::atomic<size_t> s_copy_count{0};
+    std::vector<char> m_data;
+};
+
+TEST_F(CoroutinesCppMtTest, MoveOnlyTaskResult) {
+    constexpr size_t PAYLOAD_SIZE = 4 * 1024 * 1024;
+    static std::atomic<bool> is_ok{false};
+    auto main_task = []() -> nd::Task<> {
+        auto make_int = [](int _value) -> nd::Task<std::unique_ptr<int>> { co_return std::make_unique<int>(_value); };
+        // a temporary task hands its result over
+        std::unique_ptr<int> value = co_await make_int(42);
+
+        auto payload_task = [](size_t _size) -> nd::Task<Payload> {
+            Payload payload(_size);
+            co_return payload;
+        }(PAYLOAD_SIZE);
+        // a reference into the frame, then moved out by the last awaiter
+        const Payload& kept = co_await payload_task.RunOnProcessor(WorkerGroup::BG2);
+        size_t kept_size = kept.m_data.size();
+        Payload taken = co_await std::move(payload_task);
+
+        // another handle may still read it, so the consuming awaiter gets a copy
+        auto shared_task = [](size_t _size) -> nd::Task<Payload> { co_return Payload(_size); }(PAYLOAD_SIZE);
+        nd::Task<Payload> other_handle = shared_task;
+        Payload copied = co_await std::move(shared_task);
+        const Payload& still_kept = co_await other_handle;
+
+        nd::TimeoutResult<std::unique_ptr<int>> timed = co_await make_int(7).WithTimeout(1000);  // NOLINT
+        std::unique_ptr<int> timed_value = std::move(timed).Value();
+
+        is_ok = *value == 42 && kept_size == PAYLOAD_SIZE && taken.m_data.size() == PAYLOAD_SIZE &&
+                timed_value != nullptr && *timed_value == 7 && copied.m_data.size() == PAYLOAD_SIZE &&
+                still_kept.m_data.size() == PAYLOAD_SIZE;
+    }();
+    main_task.RunOnProcessor();
+    main_task.WaitInMain();
+    EXPECT_TRUE(is_ok);
+    EXPECT_EQ(Payload::s_copy_count, 1u);
+    nd::Worker::GetMainWorker()->WaitUntilEmpty();
+}
+
+TEST_F(CoroutinesCppMtTest, AwaitTaskWithTimeout) {
+    static std::atomic<bool> is_late_returned{false};
+    is_late_returned = false;
+    auto main_task = []() -> nd::Task<> {
+        auto slow_task = []() -> nd::Task<int> {
+            co_await nd::TimeWaiter(200);  // NOLINT
+            is_late_returned = true;
+            co_return 1;
+        }();
+        auto start = nd::LoopClock::Now();
+        nd::TimeoutResult<int> late = co_await slow_task.RunOnProcessor(WorkerGroup::BG1).WithTimeout(20, 0);
+        EXPECT_TRUE(late.IsTimeout());
+        EXPECT_LT(nd::LoopClock::Now() - start, std::chrono::milliseconds(150));
+
+        auto fast_task = []() -> nd::Task<int> { co_return 7; }();
+        nd::TimeoutResult<int> in_time = co_await fast_task.RunOnProcessor(WorkerGroup::BG1).WithTimeout(1000);
+        EXPECT_FALSE(in_time.IsTimeout());
+        if (in_time) { EXPECT_EQ(*in_time, 7); }
+
+        auto void_task = []() -> nd::Task<> { co_return; }();
+        auto deadline = nd::Worker::GetCurrentWorker()->GetLoopTime() + std::chrono::seconds(1);
+        nd::TimeoutResult<void> done = co_await void_task.RunOnProcessor(WorkerGroup::BG2).WithDeadline(deadline);
+        EXPECT_TRUE(done);
+    }();
+
+    main_task.RunOnProcessor();
+    main_task.WaitInMain();
+    EXPECT_FALSE(is_late_returned);
+    // the dropped return finds no one waiting
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!is_late_returned && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    EXPECT_TRUE(is_late_returned);
+    nd::Worker::GetMainWorker()->WaitUntilEmpty();
+}
+
+TEST_F(CoroutinesCppMtTest, ManyAwaitersOfOneTask) {
+    // one awaiter is the common case, the rest and the timeouts take the overflow paths
+    constexpr int AWAITER_COUNT = 16;
+    static std::atomic<int> value_count{0};
+    static std::atomic<int> timeout_count{0};
+    value_count = 0;
+    timeout_count = 0;
+    auto shared_task = []() -> nd::Task<int> {
+        co_await nd::TimeWaiter(20);  // NOLINT
+        co_return 5;
+    }();
+    std::vector<nd::Task<>> awaiters;
+    for (int i = 0; i < AWAITER_COUNT; i++) {
+        awaiters.push_back([](nd::Task<int> _task, bool _is_timed) -> nd::Task<> {
+            if (_is_timed) {
+                nd::TimeoutResult<int> result = co_await _task.WithTimeout(1, 0);
+                if (result.IsTimeout()) { timeout_count++; }
+                co_return;
+            }
+            int result = co_await _task;
+            if (result == 5) { value_count++; }
+        }(shared_task, i % 2 == 1));
+        awaiters.back().RunOnProcessor(i % 4 == 0 ? int(WorkerGroup::BG2) : int(nd::PreDefWorkerGroup::Main));
+    }
+    shared_task.RunOnProcessor(WorkerGroup::BG1);
+    for (auto& awaiter : awaiters) { awaiter.WaitInMain(); }
+    EXPECT_EQ(value_count, AWAITER_COUNT / 2);
+    EXPECT_EQ(timeout_count, AWAITER_COUNT / 2);
+    nd::Worker::GetMainWorker()->WaitUntilEmpty();
+}
+
+// each level starts the next one in place by awaiting it
+static nd::Task<int> CountDown(int _level) {
+    if (_level == 0) { co_return 0; }
+    int below = co_await CountDown(_level - 1);
+    co_return below + 1;
+}
+
+TEST_F(CoroutinesCppMtTest, SymmetricTransfer) {
+    // a deep chain on one worker neither queues a resume nor grows the stack
+    constexpr int DEPTH = 10000;
+    static std::atomic<int> result{-1};
+    static std::atomic<size_t> queued_count{0};
+    auto main_task = []() -> nd::Task<> {
+        nd::Worker* worker = nd::Worker::GetCurrentWorker();
+        size_t queue_size = worker->GetQueueSize();
+        result = co_await CountDown(DEPTH);
+        queued_count = worker->GetQueueSize() - queue_size;
+    }();
+    main_task.RunOnProcessor(WorkerGroup::BG1);
+    main_task.WaitInMain();
+    EXPECT_EQ(result, DEPTH);
+    EXPECT_EQ(queued_count, 0u);
+    nd::Worker::GetMainWorker()->WaitUntilEmpty();
+}
+
+static nd::Task<size_t> Identity(size_t _value) { co_return _value; }
+
+// counts the frames alive, a parameter lives as long as the frame
+struct LiveFrame {
+    static inline std::atomic<int> s_count{0};
+    LiveFrame() { s_count++; }
+    LiveFrame(const LiveFrame&) { s_count++; }
+    ~LiveFrame() { s_count--; }
+};
+static nd::Task<size_t> CountedIdentity(size_t _value, LiveFrame) { co_return _value; }
+
+TEST_F(CoroutinesCppMtTest, WhenAllAndWhenAny) {
+    constexpr size_t TASK_COUNT = 200;
+    constexpr size_t RACE_COUNT = 1000;
+    static std::atomic<bool> is_ok{false};
+    auto main_task = []() -> nd::Task<> {
+        // fanned out over both groups, the results stay in the tasks
+        std::vector<nd::Task<size_t>> tasks;
+        for (size_t i = 0; i < TASK_COUNT; i++) {
+            tasks.push_back(Identity(i));
+            tasks.back().RunOnProcessor(i % 2 == 0 ? WorkerGroup::BG1 : WorkerGroup::BG2);
+        }
+        co_await nd::WhenAll(tasks);
+        size_t sum = 0;
+        for (auto& task : tasks) { sum += co_await task; }
+
+        // of different types, not started yet, so they run here
+        auto int_task = []() -> nd::Task<int> { co_return 1; }();
+        auto void_task = []() -> nd::Task<> { co_return; }();
+        auto string_task = []() -> nd::Task<std::string> { co_return "two"; }();
+        co_await nd::WhenAll(int_task, void_task, string_task);
+        int int_value = co_await int_task;
+        std::string string_value = co_await string_task;
+
+        // the loser runs on by itself
+        auto slow_task = []() -> nd::Task<size_t> {
+            co_await nd::TimeWaiter(200);  // NOLINT
+            co_return 0;
+        }();
+        slow_task.RunOnProcessor(WorkerGroup::BG1);
+        auto fast_task = Identity(1);
+        fast_task.RunOnProcessor(WorkerGroup::BG2);
+        size_t winner = co_await nd::WhenAny(slow_task, fast_task);
+        bool is_slow_running = !slow_task.IsDone();
+        co_await slow_task;
+
+        // the losers return while the winner's awaiter takes their waiters out
+        bool is_race_ok = true;
+        for (size_t i = 0; i < RACE_COUNT; i++) {
+            std::vector<nd::Task<size_t>> racers{CountedIdentity(0, LiveFrame()), CountedIdentity(1, LiveFrame())};
+            racers[0].RunOnProcessor(WorkerGroup::BG1);
+            racers[1].RunOnProcessor(WorkerGroup::BG2);
+            size_t race_winner = co_await nd::WhenAny(racers);
+            is_race_ok = is_race_ok && race_winner < racers.size();
+        }
+        // once the losers have returned, nothing holds the sets and their tasks any more
+        for (int i = 0; i < 500 && LiveFrame::s_count > 0; i++) { co_await nd::TimeWaiter(10); }  // NOLINT
+        is_race_ok = is_race_ok && LiveFrame::s_count == 0;
+
+        is_ok = sum == TASK_COUNT * (TASK_COUNT - 1) / 2 && int_value == 1 && void_task.IsDone() &&
+                string_value == "two" && winner == 1 && is_slow_running && is_race_ok;
+    }();
+    main_task.RunOnProcessor();
+    main_task.WaitInMain();
+    EXPECT_TRUE(is_ok);
+    nd::Worker::GetMainWorker()->WaitUntilEmpty();
+}
+
+// counts what the frames take from it
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+    CountingAllocator(std::atomic<size_t>* _allocated) : m_allocated(_allocated) {}
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& _other) : m_allocated(_other.m_allocated) {}
+    T* allocate(size_t _count) {
+        *m_allocated += _count * sizeof(T);
+        return std::allocator<T>().allocate(_count);
+    }
+    void deallocate(T* _ptr, size_t _count) {
+        *m_allocated -= _count * sizeof(T);
+        std::allocator<T>().deallocate(_ptr, _count);
+    }
+    std::atomic<size_t>* m_allocated;
+};
+
+TEST_F(CoroutinesCppMtTest, CoroutineFrameAllocator) {
+    // a pooled frame freed on another worker comes back, and the same size reuses it
+    auto main_task = []() -> nd::Task<> {
+        for (int i = 0; i < 1000; i++) {
+            auto bg_task = [](int _i) -> nd::Task<int> { co_return _i; }(i);
+            int result = co_await bg_task.RunOnProcessor(WorkerGroup::BG1);
+            EXPECT_EQ(result, i);
+        }
+    }();
+    main_task.RunOnProcessor();
+    main_task.WaitInMain();
+
+    std::atomic<size_t> allocated{0};
+    {
+        auto task = [](std::allocator_arg_t, const CountingAllocator<int>&, int _value) -> nd::Task<int> {
+            co_return _value;
+        }(std::allocator_arg, CountingAllocator<int>(&allocated), 42);
+        EXPECT_GT(allocated, 0u);
+        task.RunOnProcessor(WorkerGroup::BG1);
+        task.WaitInMain();
+    }
+    // the frame went back to the allocator once the coroutine was done
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (allocated != 0 && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    EXPECT_EQ(allocated, 0u);
+    nd::Worker::GetMainWorker()->WaitUntilEmpty();
+}
+
+TEST_F(CoroutinesCppMtTest, MultiProducerJobQueue) {
+    constexpr unsigned PRODUCER_NUM = 4;
+    constexpr size_t JOBS_PER_PRODUCER = 10000;
+
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "mpsc");
+    group.Start();
+
+    // jobs from the same producer must run in the order they were added
+    std::atomic<size_t> done_count{0};
+    std::vector<size_t> last_seq(PRODUCER_NUM, 0);
+    std::vector<std::thread> producers;
+    for (unsigned i = 0; i < PRODUCER_NUM; i++) {
+        producers.emplace_back([&, i]() {
+            for (size_t seq = 1; seq <= JOBS_PER_PRODUCER; seq++) {
+                group.AddJob(0, new nd::Job{[&, i, seq]() {
+                                 EXPECT_EQ(last_seq[i] + 1, seq);
+                                 last_seq[i] = seq;
+                                 done_count++;
+                             }});
+            }
+        });
+    }
+    for (auto& producer : producers) { producer.join(); }
+    while (done_count < PRODUCER_NUM * JOBS_PER_PRODUCER) { std::this_thread::yield(); }
+
+    // the queue size only goes down once the batch of the last job is over
+    nd::Worker* worker = group.GetWorker(0);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!worker->IsJobQueueEmpty() && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    EXPECT_TRUE(worker->IsJobQueueEmpty());
+    EXPECT_EQ(worker->GetQueueSize(), 0u);
+    group.WaitStop();
+}
+
+TEST_F(CoroutinesCppMtTest, BatchDrainBudget) {
+    nd::WorkerGroupOptions options;
+    options.m_batch_budget = 3;
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "batch", options);
+    group.Start();
+    EXPECT_EQ(group.GetWorker(0)->GetBatchBudget(), 3u);
+
+    std::atomic<size_t> done_count{0};
+    for (size_t i = 0; i < 100; i++) { group.AddJob(0, new nd::Job{[&]() { done_count++; }}); }
+    while (done_count < 100) { std::this_thread::yield(); }
+
+    group.SetBatchBudget(0);
+    EXPECT_EQ(group.GetWorker(0)->GetBatchBudget(), 1u);
+    group.AddJob(0, new nd::Job{[&]() { done_count++; }});
+    while (done_count < 101) { std::this_thread::yield(); }
+    group.WaitStop();
+
+    // a step runs no more than the budget while jobs are still queued
+    nd::Worker* main_worker = nd::Worker::GetMainWorker();
+    main_worker->WaitUntilEmpty();
+    unsigned old_budget = main_worker->GetBatchBudget();
+    main_worker->SetBatchBudget(3);
+    size_t run_count = 0;
+    for (size_t i = 0; i < 10; i++) { main_worker->AddJob([&]() { run_count++; }); }
+    for (size_t expected_count = 3; expected_count <= 9; expected_count += 3) {
+        EXPECT_EQ(main_worker->RunReadyJobs(), 3u);
+        EXPECT_EQ(run_count, expected_count);
+        EXPECT_FALSE(main_worker->IsJobQueueEmpty());
+    }
+    EXPECT_EQ(main_worker->RunReadyJobs(), 1u);
+    EXPECT_EQ(run_count, 10u);
+
+    main_worker->SetBatchBudget(0);
+    for (size_t i = 0; i < 2; i++) { main_worker->AddJob([&]() { run_count++; }); }
+    EXPECT_EQ(main_worker->RunReadyJobs(), 1u);
+    EXPECT_EQ(run_count, 11u);
+    EXPECT_EQ(main_worker->RunReadyJobs(), 1u);
+    EXPECT_EQ(run_count, 12u);
+    main_worker->SetBatchBudget(old_budget);
+}
+
+TEST_F(CoroutinesCppMtTest, InlineJobWithoutAllocation) {
+    // move-only and oversized captures still work, the latter through the heap
+    auto owned = std::make_unique<int>(1);
+    int result = 0;
+    nd::JobFunction move_only{[&result, owned = std::move(owned)]() { result = *owned; }};
+    nd::JobFunction moved = std::move(move_only);
+    EXPECT_FALSE(move_only);
+    moved();
+    EXPECT_EQ(result, 1);
+
+    char big[nd::JOB_INLINE_SIZE * 2] = {2};
+    nd::JobFunction oversized{[&result, big]() { result = big[0]; }};
+    EXPECT_FALSE(nd::JobFunction::IsInline<decltype([&result, big]() { result = big[0]; })>());
+    oversized();
+    EXPECT_EQ(result, 2);
+
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "inline");
+    group.Start();
+
+    // a resume job captures a shared_ptr and an id, it must fit inline
+    auto controller = std::make_shared<size_t>(0);
+    std::atomic<size_t> done_count{0};
+    auto post_jobs = [&](size_t _count) {
+        for (size_t i = 0; i < _count; i++) {
+            group.AddJob(0, [controller, i, &done_count]() { done_count++; });
+        }
+    };
+
+    // warm up the pool, the worker returns the blocks to this thread
+    constexpr size_t JOB_COUNT = 1000;
+    post_jobs(JOB_COUNT);
+    while (done_count < JOB_COUNT) { std::this_thread::yield(); }
+
+    size_t alloc_count = g_thread_alloc_count;
+    post_jobs(JOB_COUNT);
+    EXPECT_EQ(g_thread_alloc_count, alloc_count);
+    while (done_count < JOB_COUNT * 2) { std::this_thread::yield(); }
+    group.WaitStop();
+}
+
+TEST_F(CoroutinesCppMtTest, ResumeCoroutineOnWorker) {
+    // hops the awaiting coroutine to another worker
+    struct SwitchTo {
+        nd::Worker* m_worker;
+        // NOLINTNEXTLINE
+        bool await_ready() const noexcept { return false; }
+        // NOLINTNEXTLINE
+        void await_suspend(std::coroutine_handle<> _handle) const { m_worker->AddResume(_handle); }
+        // NOLINTNEXTLINE
+        void await_resume() const noexcept {}
+    };
+
+    auto main_task = []() -> nd::Task<> {
+        nd::Worker* main_worker = nd::Worker::GetCurrentWorker();
+        co_await SwitchTo{g_worker_mgr->GetWorker(WorkerGroup::BG1, 0)};
+        EXPECT_EQ(nd::Worker::GetCurrentWorker(), g_worker_mgr->GetWorker(WorkerGroup::BG1, 0));
+
+        // a task's start and continuation go through the nodes it carries
+        auto bg_task = []() -> nd::Task<int> { co_return 1; }();
+        int result = co_await bg_task.RunOnProcessor(WorkerGroup::BG2);
+        EXPECT_EQ(result, 1);
+        EXPECT_EQ(nd::Worker::GetCurrentWorker(), g_worker_mgr->GetWorker(WorkerGroup::BG1, 0));
+
+        co_await SwitchTo{main_worker};
+        EXPECT_EQ(nd::Worker::GetCurrentWorker(), main_worker);
+    }();
+
+    main_task.RunOnProcessor();
+    main_task.WaitInMain();
+    nd::Worker::GetMainWorker()->WaitUntilEmpty();
+}
+
+TEST_F(CoroutinesCppMtTest, ParkedWorkerWakeUp) {
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "park");
+    group.Start();
+
+    // an idle worker sleeps for good, a job must still wake it up at once
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::atomic<bool> is_done{false};
+    auto start = std::chrono::steady_clock::now();
+    group.AddJob(0, [&]() { is_done = true; });
+    while (!is_done) { std::this_thread::yield(); }
+    // generous, a loaded machine may be slow to schedule the worker
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+    // a worker with a timer sleeps until the deadline, not in slices
+    is_done = false;
+    start = std::chrono::steady_clock::now();
+    group.AddJob(0, [&]() {
+        nd::Worker::GetCurrentWorker()->AddLocalTimer(30, [&]() { is_done = true; });
+    });
+    while (!is_done) { std::this_thread::yield(); }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(30));
+    EXPECT_LT(elapsed, std::chrono::milliseconds(500));
+    group.WaitStop();
+}
+
+TEST_F(CoroutinesCppMtTest, WorkStealing) {
+    nd::WorkerGroupOptions options;
+    options.m_work_stealing = true;
+    nd::WorkerGroup group(WorkerGroup::MAX, 4, "steal", options);
+    group.Start();
+
+    // worker 0 is stuck until every session-less job is done, so its share must be stolen
+    constexpr int JOB_COUNT = 1000;
+    std::atomic<int> done_count{0};
+    std::atomic<bool> is_blocked{false};
+    group.AddJob(0, [&]() {
+        is_blocked = true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (done_count < JOB_COUNT && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    });
+    while (!is_blocked) { std::this_thread::yield(); }
+
+    std::vector<int> session_order;
+    for (int i = 0; i < JOB_COUNT; i++) {
+        group.AddJob(nd::ANY_SESSION, [&]() { done_count++; });
+        // session jobs keep their order and their worker
+        group.AddJob(1, [&session_order, i]() { session_order.push_back(i); });
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (done_count < JOB_COUNT && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    EXPECT_EQ(done_count, JOB_COUNT);
+
+    group.WaitStop();
+    ASSERT_EQ(session_order.size(), size_t(JOB_COUNT));
+    for (int i = 0; i < JOB_COUNT; i++) { EXPECT_EQ(session_order[i], i); }
+
+    // lanes with more than a batch still leave room for the worker's own session-less jobs
+    nd::Worker* main_worker = nd::Worker::GetMainWorker();
+    main_worker->WaitUntilEmpty();
+    size_t lane_job_count = main_worker->GetBatchBudget() * 10;
+    for (size_t i = 0; i < lane_job_count; i++) { main_worker->AddJob([]() {}); }
+    bool is_stealable_run = false;
+    main_worker->AddStealableJob(new nd::Job{[&]() { is_stealable_run = true; }});
+    main_worker->RunReadyJobs();
+    EXPECT_TRUE(is_stealable_run);
+    main_worker->WaitUntilEmpty();
+}
+
+TEST_F(CoroutinesCppMtTest, BoundedQueueBackpressure) {
+    nd::WorkerGroupOptions options;
+    options.m_queue_capacity = 4;
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "bounded", options);
+    group.Start();
+
+    // hold the worker, the running job still counts until its batch ends
+    std::atomic<bool> is_blocked{false};
+    std::atomic<bool> is_released{false};
+    group.AddJob(0, [&]() {
+        is_blocked = true;
+        while (!is_released) { std::this_thread::yield(); }
+    });
+    while (!is_blocked) { std::this_thread::yield(); }
+
+    std::vector<int> order;
+    size_t accepted_count = 0;
+    while (true) {
+        auto* job = new nd::Job([&order, accepted_count]() { order.push_back(int(accepted_count)); });
+        if (!group.TryAddJob(0, job)) {
+            delete job;
+            break;
+        }
+        accepted_count++;
+    }
+    EXPECT_EQ(accepted_count, options.m_queue_capacity - 1);
+    EXPECT_EQ(group.GetWorker(0)->GetQueueSize(), options.m_queue_capacity);
+
+    // the producer coroutine stays suspended until the worker frees a slot
+    std::atomic<int> submitted_count{0};
+    auto producer = [](nd::WorkerGroup& _group, std::vector<int>& _order, std::atomic<int>& _submitted_count,
+                       int _first) -> nd::Task<> {
+        for (int i = _first; i < _first + 8; i++) {
+            co_await _group.AwaitAddJob(0, [&_order, i]() { _order.push_back(i); });
+            _submitted_count++;
+        }
+    }(group, order, submitted_count, int(accepted_count));
+    producer.RunOnProcessor();
+    for (int i = 0; i < 10; i++) { nd::Worker::GetMainWorker()->WaitUntilEmpty(); }
+    EXPECT_EQ(submitted_count, 0);
+    EXPECT_FALSE(producer.IsDone());
+
+    is_released = true;
+    producer.WaitInMain();
+    EXPECT_EQ(submitted_count, 8);
+    group.WaitStop();
+
+    ASSERT_EQ(order.size(), accepted_count + 8);
+    for (size_t i = 0; i < order.size(); i++) { EXPECT_EQ(order[i], int(i)); }
+}
+
+TEST_F(CoroutinesCppMtTest, PriorityLanes) {
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "lanes");
+    group.Start();
+
+    std::atomic<bool> is_blocked{false};
+    std::atomic<bool> is_released{false};
+    // the blocker is the first job of the first high round
+    group.AddJob(
+        0,
+        [&]() {
+            is_blocked = true;
+            while (!is_released) { std::this_thread::yield(); }
+        },
+        nd::JobPriority::High);
+    while (!is_blocked) { std::this_thread::yield(); }
+
+    // queued low first, high last
+    constexpr int JOB_COUNT = 20;
+    std::vector<nd::JobPriority> order;
+    for (auto priority : {nd::JobPriority::Low, nd::JobPriority::Normal, nd::JobPriority::High}) {
+        for (int i = 0; i < JOB_COUNT; i++) {
+            group.AddJob(0, [&order, priority]() { order.push_back(priority); }, priority);
+        }
+    }
+    nd::Worker* worker = group.GetWorker(0);
+    EXPECT_EQ(worker->GetLaneSize(nd::JobPriority::High), size_t(JOB_COUNT + 1));
+    EXPECT_EQ(worker->GetLaneSize(nd::JobPriority::Normal), size_t(JOB_COUNT));
+    EXPECT_EQ(worker->GetLaneSize(nd::JobPriority::Low), size_t(JOB_COUNT));
+
+    is_released = true;
+    group.WaitStop();
+    ASSERT_EQ(order.size(), size_t(JOB_COUNT * 3));
+
+    // a round takes the lanes by weight, high first, low still gets its share
+    size_t first_high_count = nd::JOB_LANE_WEIGHTS[0] - 1;
+    auto round = order.begin() + first_high_count + nd::JOB_LANE_WEIGHTS[1] + nd::JOB_LANE_WEIGHTS[2];
+    EXPECT_TRUE(std::all_of(order.begin(), order.begin() + first_high_count,
+                            [](auto _priority) { return _priority == nd::JobPriority::High; }));
+    EXPECT_EQ(std::count(order.begin(), round, nd::JobPriority::Low), 1);
+    EXPECT_EQ(std::count(order.begin(), order.end(), nd::JobPriority::Low), JOB_COUNT);
+    EXPECT_EQ(order.back(), nd::JobPriority::Low);
+}
+
+TEST_F(CoroutinesCppMtTest, BulkSubmission) {
+    nd::WorkerGroup group(WorkerGroup::MAX, 2, "bulk");
+    group.Start();
+
+    constexpr size_t SESSION_COUNT = 4;
+    constexpr size_t JOB_COUNT = 1000;
+    std::vector<int> session_orders[SESSION_COUNT];
+    std::atomic<size_t> any_count{0};
+    std::vector<nd::SessionJob> jobs;
+    for (size_t i = 0; i < JOB_COUNT; i++) {
+        if (i % 5 == 4) {
+            jobs.push_back({nd::ANY_SESSION, new nd::Job([&any_count]() { any_count++; })});
+            continue;
+        }
+        size_t session_id = i % SESSION_COUNT;
+        jobs.push_back({session_id, new nd::Job([&session_orders, session_id, i]() {
+                            session_orders[session_id].push_back(int(i));
+                        })});
+    }
+    group.AddJobs(jobs);
+    group.WaitStop();
+
+    EXPECT_EQ(any_count, JOB_COUNT / 5);
+    size_t session_job_count = 0;
+    for (auto& order : session_orders) {
+        EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+        session_job_count += order.size();
+    }
+    EXPECT_EQ(session_job_count, JOB_COUNT - JOB_COUNT / 5);
+}
+
+TEST_F(CoroutinesCppMtTest, SessionRouting) {
+    constexpr unsigned WORKER_COUNT = 8;
+    constexpr nd::SessionId SESSION_COUNT = 80000;
+    for (auto routing :
+         {nd::SessionRouting::Modulo, nd::SessionRouting::Mask, nd::SessionRouting::Hash, nd::SessionRouting::JumpHash}) {
+        auto router = nd::MakeSessionRouter(routing);
+        // strided ids, the worst case for the plain modulo
+        std::vector<size_t> counts(WORKER_COUNT, 0);
+        for (nd::SessionId id = 0; id < SESSION_COUNT; id++) {
+            unsigned worker_id = router->Route(id * WORKER_COUNT, WORKER_COUNT);
+            ASSERT_LT(worker_id, WORKER_COUNT);
+            EXPECT_EQ(worker_id, router->Route(id * WORKER_COUNT, WORKER_COUNT));
+            counts[worker_id]++;
+        }
+        if (routing == nd::SessionRouting::Hash || routing == nd::SessionRouting::JumpHash) {
+            for (size_t count : counts) { EXPECT_NEAR(double(count), double(SESSION_COUNT / WORKER_COUNT), 1000.0); }
+        }
+    }
+
+    // growing the group moves about 1/n of the sessions, all to the new worker
+    nd::JumpHashRouter jump_hash;
+    size_t moved_count = 0;
+    for (nd::SessionId id = 0; id < SESSION_COUNT; id++) {
+        unsigned before = jump_hash.Route(id, WORKER_COUNT);
+        unsigned after = jump_hash.Route(id, WORKER_COUNT + 1);
+        if (before == after) { continue; }
+        EXPECT_EQ(after, WORKER_COUNT);
+        moved_count++;
+    }
+    EXPECT_NEAR(double(moved_count), double(SESSION_COUNT / (WORKER_COUNT + 1)), 1000.0);
+
+    // session-less jobs go to the shorter of two queues
+    nd::WorkerGroupOptions options;
+    options.m_session_router = nd::MakeSessionRouter(nd::SessionRouting::Hash);
+    options.m_any_session_routing = nd::AnySessionRouting::LeastLoaded;
+    nd::WorkerGroup group(WorkerGroup::MAX, 2, "route", options);
+    group.Start();
+    std::atomic<bool> is_released{false};
+    nd::Worker* blocked_worker = group.GetWorker(0);
+    blocked_worker->AddJob([&]() {
+        while (!is_released) { std::this_thread::yield(); }
+    });
+    for (int i = 0; i < 1000; i++) { blocked_worker->AddJob([]() {}); }
+    std::atomic<int> done_count{0};
+    for (int i = 0; i < 100; i++) { group.AddJob(nd::ANY_SESSION, [&]() { done_count++; }); }
+    // the free worker takes all of them while the other one is stuck
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (done_count < 100 && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    EXPECT_EQ(done_count, 100);
+    is_released = true;
+    group.WaitStop();
+    EXPECT_EQ(done_count, 100);
+
+    // the reserved id is no session, even without stealing its workers are handed out in turn
+    nd::WorkerGroup round_robin_group(WorkerGroup::MAX, 2, "any");
+    round_robin_group.Start();
+    EXPECT_NE(round_robin_group.GetWorker(nd::ANY_SESSION), round_robin_group.GetWorker(nd::ANY_SESSION));
+    round_robin_group.WaitStop();
+}
+
+TEST_F(CoroutinesCppMtTest, ElasticWorkerGroup) {
+    constexpr nd::SessionId SESSION_COUNT = 32;
+    constexpr int JOBS_PER_ROUND = 50;
+    nd::WorkerGroupOptions options;
+    options.m_max_thread_count = 4;
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "elastic", options);
+    group.Start();
+    EXPECT_EQ(group.GetThreadCount(), 1u);
+
+    std::atomic<int> next_seqs[SESSION_COUNT] = {};
+    std::atomic<int> last_seqs[SESSION_COUNT];
+    for (auto& last_seq : last_seqs) { last_seq = -1; }
+    std::atomic<int> out_of_order_count{0};
+    std::atomic<int> done_count{0};
+    // every job checks that it runs right after the previous one of its session
+    auto post_round = [&]() {
+        for (int i = 0; i < JOBS_PER_ROUND; i++) {
+            for (nd::SessionId id = 0; id < SESSION_COUNT; id++) {
+                int seq = next_seqs[id]++;
+                group.AddJob(id, [&, id, seq]() {
+                    if (last_seqs[id].exchange(seq) != seq - 1) { out_of_order_count++; }
+                    done_count++;
+                });
+            }
+        }
+    };
+
+    std::atomic<bool> is_released{false};
+    group.GetWorker(0)->AddJob([&]() {
+        while (!is_released) { std::this_thread::yield(); }
+    });
+    post_round();
+    // the resize waits for the stuck worker to hand its queued jobs over
+    std::thread resizer([&]() { EXPECT_EQ(group.Resize(3), 3u); });
+    while (group.GetThreadCount() != 3) { std::this_thread::yield(); }
+    post_round();
+    is_released = true;
+    resizer.join();
+
+    // a grow only holds the new worker back, the others keep running while it waits for the busy one
+    is_released = false;
+    group.GetWorker(0)->AddJob([&]() {
+        while (!is_released) { std::this_thread::yield(); }
+    });
+    std::vector<nd::Worker*> old_workers;
+    for (nd::SessionId id = 0; id < SESSION_COUNT; id++) { old_workers.push_back(group.GetWorker(id)); }
+    resizer = std::thread([&]() { EXPECT_EQ(group.Resize(4), 4u); });
+    while (group.GetThreadCount() != 4) { std::this_thread::yield(); }
+    // a session which stays on another former worker
+    nd::SessionId other_id = 1;
+    while (old_workers[other_id] == old_workers[0] || group.GetWorker(other_id) != old_workers[other_id]) {
+        other_id++;
+    }
+    ASSERT_LT(other_id, SESSION_COUNT);
+    std::atomic<bool> is_run{false};
+    group.AddJob(other_id, [&]() { is_run = true; });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!is_run && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    EXPECT_TRUE(is_run);
+    is_released = true;
+    resizer.join();
+
+    // a job may feed its own group while the group shrinks
+    std::atomic<int> chained_count{0};
+    group.AddJob(0, [&]() {
+        for (int i = 0; i < 100; i++) { group.AddJob(i, [&]() { chained_count++; }); }
+    });
+    post_round();
+    EXPECT_EQ(group.Resize(1), 1u);
+    EXPECT_EQ(group.GetThreadCount(), 1u);
+    post_round();
+    group.WaitStop();
+    EXPECT_EQ(done_count, int(4 * JOBS_PER_ROUND * SESSION_COUNT));
+    EXPECT_EQ(chained_count, 100);
+    EXPECT_EQ(out_of_order_count, 0);
+}
+
+TEST_F(CoroutinesCppMtTest, BackToBackResize) {
+    constexpr nd::SessionId SESSION_COUNT = 64;
+    constexpr int JOBS_PER_ROUND = 20;
+    constexpr int ROUND_COUNT = 40;
+    nd::WorkerGroupOptions options;
+    options.m_max_thread_count = 4;
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "resize", options);
+    group.Start();
+
+    std::atomic<int> next_seqs[SESSION_COUNT] = {};
+    std::atomic<int> last_seqs[SESSION_COUNT];
+    for (auto& last_seq : last_seqs) { last_seq = -1; }
+    std::atomic<int> out_of_order_count{0};
+    std::atomic<int> done_count{0};
+    auto post_round = [&]() {
+        for (int i = 0; i < JOBS_PER_ROUND; i++) {
+            for (nd::SessionId id = 0; id < SESSION_COUNT; id++) {
+                int seq = next_seqs[id]++;
+                group.AddJob(id, [&, id, seq]() {
+                    if (last_seqs[id].exchange(seq) != seq - 1) { out_of_order_count++; }
+                    // slow enough for the backlogs to outlive a resize
+                    auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(5);
+                    while (std::chrono::steady_clock::now() < until) {}
+                    done_count++;
+                });
+            }
+        }
+    };
+
+    // the second resize comes before the workers took what the first one handed over
+    const unsigned thread_counts[] = {4, 2, 3, 1};
+    for (int round = 0; round < ROUND_COUNT; round++) {
+        post_round();
+        group.Resize(thread_counts[round % 4]);
+        group.Resize(thread_counts[(round + 1) % 4]);
+    }
+    post_round();
+    group.WaitStop();
+    EXPECT_EQ(done_count, int((ROUND_COUNT + 1) * JOBS_PER_ROUND * SESSION_COUNT));
+    EXPECT_EQ(out_of_order_count, 0);
+}
+
+#ifdef __linux__
+TEST_F(CoroutinesCppMtTest, ExternalEventLoop) {
+    // the host loop owns the sleep, the main worker only runs what is ready
+    nd::Worker* main_worker = nd::Worker::GetMainWorker();
+    main_worker->RunReadyJobs();
+    struct pollfd poll_fd = {main_worker->GetEventFd(), POLLIN, 0};
+    ASSERT_GE(poll_fd.fd, 0);
+    EXPECT_EQ(main_worker->PrepareWait(), -1);
+    EXPECT_EQ(poll(&poll_fd, 1, 0), 0);
+
+    std::atomic<bool> is_done{false};
+    g_worker_mgr->RunOnWorkerGroup(WorkerGroup::BG1, 0, [&]() {
+        g_worker_mgr->RunOnMainThread([&]() { is_done = true; });
+    });
+    EXPECT_EQ(poll(&poll_fd, 1, 5000), 1);
+    EXPECT_EQ(main_worker->RunReadyJobs(), 1u);
+    EXPECT_TRUE(is_done);
+
+    // no job, the timer bounds the sleep
+    bool is_fired = false;
+    main_worker->AddLocalTimer(20, [&]() { is_fired = true; });
+    nd::CppTimePoint deadline;
+    EXPECT_TRUE(main_worker->GetNextDeadline(deadline));
+    int timeout_ms = main_worker->PrepareWait();
+    EXPECT_GT(timeout_ms, 0);
+    EXPECT_LE(timeout_ms, 20);
+    EXPECT_EQ(poll(&poll_fd, 1, timeout_ms), 0);
+    EXPECT_EQ(main_worker->RunReadyJobs(), 0u);
+    EXPECT_TRUE(is_fired);
+    EXPECT_FALSE(main_worker->GetNextDeadline(deadline));
+}
+#endif
+
+TEST_F(CoroutinesCppMtTest, TimerWheel) {
+    // driven by hand, from the near level up to the farthest one
+    auto start = std::chrono::steady_clock::now();
+    nd::TimerWheel wheel(start);
+    const uint64_t delays_ms[] = {0, 1, 5, 255, 256, 300, 20000, 70000, 3000000, 100000000, 5000000000};
+    std::vector<nd::min_heap_item_t*> timers;
+    for (uint64_t delay_ms : delays_ms) {
+        auto timer = new nd::min_heap_item_t();
+        timer->timeout = start + std::chrono::milliseconds(delay_ms) + std::chrono::microseconds(100);
+        wheel.Add(timer);
+        timers.push_back(timer);
+    }
+    // cancelled timers are simply unlinked
+    auto cancelled = new nd::min_heap_item_t();
+    cancelled->timeout = start + std::chrono::milliseconds(300);
+    wheel.Add(cancelled);
+    wheel.Remove(cancelled);
+    delete cancelled;
+    EXPECT_EQ(wheel.Size(), timers.size());
+
+    size_t fired_count = 0;
+    nd::CppTimePoint deadline;
+    while (wheel.GetNextDeadline(deadline)) {
+        // jump from deadline to deadline like a parked worker
+        wheel.Expire(deadline);
+        while (nd::min_heap_item_t* timer = wheel.PopExpired()) {
+            ASSERT_LT(fired_count, timers.size());
+            EXPECT_EQ(timer, timers[fired_count]);
+            // never early, at most a tick late
+            EXPECT_LE(timer->timeout, deadline);
+            EXPECT_GT(timer->timeout + std::chrono::milliseconds(1), deadline);
+            fired_count++;
+            delete timer;
+        }
+    }
+    EXPECT_EQ(fired_count, timers.size());
+
+    // the backend of a group
+    nd::WorkerGroupOptions options;
+    options.m_timer_backend = nd::TimerBackend::Wheel;
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "wheel", options);
+    group.Start();
+    std::atomic<int> fired_mask{0};
+    group.AddJob(0, [&]() {
+        nd::Worker* worker = nd::Worker::GetCurrentWorker();
+        auto added_at = std::chrono::steady_clock::now();
+        worker->AddLocalTimer(30, [&, added_at]() {
+            EXPECT_GE(std::chrono::steady_clock::now() - added_at, std::chrono::milliseconds(30));
+            fired_mask |= 1;
+        });
+        nd::TimerHandle to_cancel = worker->AddLocalTimer(10, [&]() { fired_mask |= 2; });
+        worker->AddLocalTimer(5, [&, worker, to_cancel]() mutable {
+            worker->CancelLocalTimer(to_cancel);
+            fired_mask |= 4;
+        });
+    });
+    auto wait_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (fired_mask != 5 && std::chrono::steady_clock::now() < wait_deadline) { std::this_thread::yield(); }
+    group.WaitStop();
+    EXPECT_EQ(fired_mask, 5);
+}
+
+TEST_F(CoroutinesCppMtTest, TimerPool) {
+    for (auto backend : {nd::TimerBackend::Heap, nd::TimerBackend::Wheel}) {
+        nd::WorkerGroupOptions options;
+        options.m_timer_backend = backend;
+        nd::WorkerGroup group(WorkerGroup::MAX, 1, "timer", options);
+        group.Start();
+        std::atomic<int> fired_mask{0};
+        std::atomic<size_t> alloc_count{SIZE_MAX};
+        group.AddJob(0, [&]() {
+            nd::Worker* worker = nd::Worker::GetCurrentWorker();
+            // the first timer carves the slab
+            nd::TimerHandle first = worker->AddLocalTimer(1000, [&]() { fired_mask |= 1; });
+            nd::TimerHandle stale = first;
+            worker->CancelLocalTimer(first);
+            EXPECT_TRUE(first == nullptr);
+
+            // the slot is reused, the stale handle must not cancel its new timer
+            size_t alloc_count_before = g_thread_alloc_count;
+            nd::TimerHandle second = worker->AddLocalTimer(5, [&fired_mask]() { fired_mask |= 2; });
+            alloc_count = g_thread_alloc_count - alloc_count_before;
+            EXPECT_TRUE(second.Get() != nullptr);
+            worker->CancelLocalTimer(stale);
+            EXPECT_TRUE(second.Get() != nullptr);
+
+            // nor does a handle of a fired timer, even cancelled from its own callback
+            auto self = std::make_shared<nd::TimerHandle>();
+            *self = worker->AddLocalTimer(1, [&fired_mask, worker, self]() {
+                worker->CancelLocalTimer(*self);
+                fired_mask |= 4;
+            });
+        });
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (fired_mask != 6 && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+        group.WaitStop();
+        EXPECT_EQ(fired_mask, 6);
+        // a small capture lives in the entry
+        EXPECT_EQ(alloc_count, 0u);
+    }
+}
+
+TEST_F(CoroutinesCppMtTest, TimerSlack) {
+    nd::WorkerGroupOptions options;
+    options.m_timer_slack_ms = 64;
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "slack", options);
+    group.Start();
+    constexpr int TIMER_COUNT = 100;
+    std::atomic<int> fired_count{0};
+    std::atomic<size_t> deadline_count{0};
+    std::atomic<bool> is_exact{false};
+    group.AddJob(0, [&]() {
+        nd::Worker* worker = nd::Worker::GetCurrentWorker();
+        std::vector<nd::CppTimePoint> deadlines;
+        for (int i = 0; i < TIMER_COUNT; i++) {
+            // spread over 20 ms, each fires in its own [deadline, deadline + slack] window,
+            // counted from the loop time of the batch
+            auto earliest = worker->GetLoopTime() + std::chrono::milliseconds(i / 5);
+            nd::TimerHandle timer = worker->AddLocalTimer(i / 5, [&, earliest]() {
+                EXPECT_GE(nd::LoopClock::Now(), earliest);
+                fired_count++;
+            });
+            nd::CppTimePoint deadline = timer.Get()->timeout;
+            EXPECT_GE(deadline, earliest);
+            EXPECT_LE(deadline, earliest + std::chrono::milliseconds(64 + 2));
+            deadlines.push_back(deadline);
+        }
+        std::sort(deadlines.begin(), deadlines.end());
+        deadline_count = std::unique(deadlines.begin(), deadlines.end()) - deadlines.begin();
+
+        // 0 overrides the worker's slack
+        auto added_at = std::chrono::steady_clock::now();
+        nd::TimerHandle exact = worker->AddLocalTimer(3, [&]() { fired_count++; }, 0);
+        is_exact = exact.Get()->timeout - added_at < std::chrono::milliseconds(4);
+    });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (fired_count < TIMER_COUNT + 1 && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    group.WaitStop();
+    EXPECT_EQ(fired_count, TIMER_COUNT + 1);
+    EXPECT_TRUE(is_exact);
+    // the aligned boundaries are shared, a 64 ms slack leaves room for a couple of them over 20 ms
+    EXPECT_LE(deadline_count, 3u);
+}
+
+TEST_F(CoroutinesCppMtTest, RemoteTimer) {
+    nd::WorkerGroup group(WorkerGroup::MAX, 2, "remote", {});
+    group.Start();
+
+    // fires on the worker of the session
+    std::atomic<nd::Worker*> fired_on{nullptr};
+    nd::RemoteTimer fired = group.AddTimer(1, 5, [&]() { fired_on = nd::Worker::GetCurrentWorker(); });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (fired_on == nullptr && std::chrono::steady_clock::now() < deadline) { std::this_thread::yield(); }
+    EXPECT_EQ(fired_on, group.GetWorker(1));
+    EXPECT_FALSE(fired.Cancel());
+
+    // cancelled before it is due, whether the worker armed it yet or not
+    std::atomic<int> cancelled_fired_count{0};
+    nd::RemoteTimer cancelled = group.AddTimer(0, 20, [&]() { cancelled_fired_count++; });
+    EXPECT_TRUE(cancelled.Cancel());
+    EXPECT_FALSE(cancelled.Cancel());
+
+    // producers race the deadlines, every timer either fires or is cancelled, never both
+    constexpr int PRODUCER_COUNT = 4;
+    constexpr int TIMER_COUNT = 2000;
+    std::atomic<int> fired_count{0};
+    std::atomic<int> cancel_count{0};
+    std::vector<std::thread> producers;
+    for (int i = 0; i < PRODUCER_COUNT; i++) {
+        producers.emplace_back([&, i]() {
+            for (int j = 0; j < TIMER_COUNT; j++) {
+                nd::RemoteTimer timer = group.AddTimer(j, j % 3, [&]() { fired_count++; });
+                if ((i + j) % 2 == 0 && timer.Cancel()) { cancel_count++; }
+            }
+        });
+    }
+    for (auto& producer : producers) { producer.join(); }
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (fired_count + cancel_count < PRODUCER_COUNT * TIMER_COUNT && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(fired_count + cancel_count, PRODUCER_COUNT * TIMER_COUNT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    group.WaitStop();
+    EXPECT_EQ(cancelled_fired_count, 0);
+    EXPECT_EQ(fired_count + cancel_count, PRODUCER_COUNT * TIMER_COUNT);
+}
+
+TEST_F(CoroutinesCppMtTest, LoopClock) {
+    // the TSC, where there is an invariant one, keeps in step with the steady clock
+    if (nd::LoopClock::EnableTsc()) {
+        EXPECT_TRUE(nd::LoopClock::IsTscEnabled());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto drift = nd::LoopClock::Now() - std::chrono::steady_clock::now();
+        EXPECT_LT(std::chrono::abs(drift), std::chrono::milliseconds(2));
+    }
+    auto last = nd::LoopClock::Now();
+    for (int i = 0; i < 100000; i++) {
+        auto now = nd::LoopClock::Now();
+        EXPECT_GE(now, last);
+        last = now;
+    }
+    auto wall_drift = nd::LoopClock::ToWallTime(nd::LoopClock::Now()) - std::chrono::system_clock::now();
+    EXPECT_LT(std::chrono::abs(wall_drift), std::chrono::seconds(1));
+
+    nd::WorkerGroup group(WorkerGroup::MAX, 1, "clock", {});
+    group.Start();
+    std::atomic<bool> is_done{false};
+    group.AddJob(0, [&]() {
+        nd::Worker* worker = nd::Worker::GetCurrentWorker();
+        // a job reads the same loop time however long it takes
+        nd::TimerHandle first = worker->AddLocalTimer(10, []() {}, 0);
+        auto busy_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+        while (std::chrono::steady_clock::now() < busy_until) {}
+        nd::TimerHandle second = worker->AddLocalTimer(10, []() {}, 0);
+        EXPECT_EQ(first.Get()->timeout, second.Get()->timeout);
+        EXPECT_LE(worker->GetLoopTime(), nd::LoopClock::Now() - std::chrono::milliseconds(2));
+        worker->CancelLocalTimer(first);
+        worker->CancelLocalTimer(second);
+        is_done = true;
+    });
+    while (!is_done) { std::this_thread::yield(); }
+    group.WaitStop();
+}
+
+TEST_F(CoroutinesCppMtTest, WorkerPlacement) {
+    // the physical cores and the cpus of node 0 are never empty on linux
+    std::vector<int> cores = nd::ResolvePlacement(nd::PlacementSpec::OnePerPhysicalCore(), 2);
+    std::vector<int> node_cpus = nd::ResolvePlacement(nd::PlacementSpec::CompactOn(0), 2);
+    ASSERT_EQ(cores.size(), 2u);
+    ASSERT_EQ(node_cpus.size(), 2u);
+#ifdef __linux__
+    EXPECT_GE(cores[0], 0);
+    EXPECT_GE(node_cpus[0], 0);
+#endif
+
+    nd::WorkerGroupOptions options;
+    options.m_placement = nd::PlacementSpec::Cpus({0});
+    nd::WorkerGroup group(WorkerGroup::MAX, 2, "pin", options);
+    group.Start();
+    std::atomic<int> done_count{0};
+    std::string names[2];
+    for (unsigned i = 0; i < 2; i++) {
+        nd::Worker* worker = group.GetWorker(i);
+#ifdef __linux__
+        EXPECT_EQ(worker->GetCpu(), 0);
+        EXPECT_EQ(worker->GetNumaNode(), nd::NumaNodeOfCpu(0));
+#endif
+        worker->AddJob([&, i]() {
+            names[i] = nd::Worker::GetCurrWorkerName();
+            done_count++;
+        });
+    }
+    while (done_count < 2) { std::this_thread::yield(); }
+    group.WaitStop();
+#ifdef __linux__
+    EXPECT_NE(names[0].find("cpu0/n"), std::string::npos) << names[0];
+    EXPECT_NE(names[1].find("cpu0/n"), std::string::npos) << names[1];
+#endif
+}